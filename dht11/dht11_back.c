@@ -1,3 +1,4 @@
+#define _GNU_SOURCE             // pipe2()
 #include <wiringPi.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,7 +7,20 @@
 #include <time.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
 #include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "../lcd/rpilcd_ioctl.h"
+#include "../lcd/rpilcd_comp.h"
+#include "dht11_decode.h"
+#include "dht11_ring.h"
+#include "dht11_store.h"
 
 //#include <bcm2835.h>
 
@@ -14,19 +28,23 @@
 #define MAX_TRIES 100
 #define DHT11PIN 7
 
+// schedules of the main loop, in milliseconds
+#define SENSOR_PERIOD 2000
+#define SENSOR_RETRY 3000
+#define DISPLAY_PERIOD 1000
+#define SERVO_PERIOD 2000
+#define REPORT_PERIOD 60000
+
 // ---------------------------------------------------
 // DHT11 FUNCTIONS
 // ---------------------------------------------------
-int dht11_val[5] = {0,0,0,0,0};
-
 int dht11_read_val(int *h, int *t) {
+  static const struct dht11_decode_cfg cfg = DHT11_DECODE_COUNTER;
+  uint32_t durations[MAX_TIME];
+  struct dht11_reading reading;
   uint8_t lststate = HIGH;
   uint8_t counter = 0;
-  uint8_t j = 0, i;
-  
-  for (i = 0; i < 5; i++) {
-     dht11_val[i] = 0;
-  }
+  uint8_t i;
 
   pinMode(DHT11PIN,OUTPUT);
   digitalWrite(DHT11PIN,LOW);
@@ -35,6 +53,7 @@ int dht11_read_val(int *h, int *t) {
   delayMicroseconds(40);
   pinMode(DHT11PIN,INPUT);
 
+  // record the length of every level, decoding is done afterwards
   for (i = 0; i < MAX_TIME; i++) {
     counter = 0;
     while (digitalRead(DHT11PIN) == lststate){
@@ -48,22 +67,14 @@ int dht11_read_val(int *h, int *t) {
     if (counter == 255) {
        break;
     }
-    // top 3 transitions are ignored
-    if ((i >= 4) && (i%2 == 0)) {
-      dht11_val[j/8] <<= 1;
-      if(counter > 16) {
-        dht11_val[j/8] |= 1;
-      }
-      j++;
-    }
+    durations[i] = counter;
   }
 
-  // verify cheksum and print the verified data
-  if ((j >= 40) && (dht11_val[4] == ((dht11_val[0] + dht11_val[1] + dht11_val[2] + dht11_val[3]) & 0xFF))) {
+  if (dht11_decode(durations, i, &cfg, &reading) == DHT11_OK) {
     // Only return the integer part of humidity and temperature. The sensor
     // is not accurate enough for decimals anyway 
-    *h = dht11_val[0];
-    *t = dht11_val[2];
+    *h = reading.humidity;
+    *t = reading.temperature;
     return 0;
   }
   else {
@@ -72,15 +83,82 @@ int dht11_read_val(int *h, int *t) {
   }
 }
 
+// read the sensor through the rpidht11 kernel driver, if it is loaded
+int dht11_read_dev(int fd, int *h, int *t) {
+  char buf[16];
+  ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+  if (len <= 0) {
+    return 1;
+  }
+  buf[len] = '\0';
+  if (sscanf(buf, "%d %d", h, t) != 2) {
+    return 1;
+  }
+  return 0;
+}
+
+// ---------------------------------------------------
+// SERVO FUNCTIONS
+// ---------------------------------------------------
+#define SERVO_FIFO "/run/servo.fifo"
+#define SERVO_SYSFS "/sys/class/rpiservo_class/rpiservo/temp"
+
+// send the temperature to the rpiservo kernel driver, to a running
+// "servo -d", or start ./servo once
+void set_servo(int t) {
+  static int sysfd = -2;
+  static int fd = -1;
+  char line[64];
+
+  if (sysfd == -2) {
+    sysfd = open(SERVO_SYSFS, O_WRONLY);
+  }
+  if (sysfd >= 0) {
+    int len = snprintf(line, sizeof(line), "%d\n", t);
+    if (pwrite(sysfd, line, len, 0) == len) {
+      return;
+    }
+  }
+
+  if (fd < 0) {
+    struct stat st;
+    // fails with ENXIO when no daemon is reading
+    fd = open(SERVO_FIFO, O_WRONLY | O_NONBLOCK | O_NOFOLLOW | O_CLOEXEC);
+    // never write the temperature into a file found at that path
+    if (fd >= 0 && (fstat(fd, &st) < 0 || !S_ISFIFO(st.st_mode))) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  if (fd >= 0) {
+    int len = snprintf(line, sizeof(line), "%d\n", t);
+    if (write(fd, line, len) == len) {
+      return;
+    }
+    // daemon went away (EPIPE, SIGPIPE is ignored in main)
+    close(fd);
+    fd = -1;
+  }
+  snprintf(line, sizeof(line), "./servo %d", t);
+  system(line);
+}
+
 // ---------------------------------------------------
 // LCD DEVICE FUNCTIONS
 // ---------------------------------------------------
+// set when the panel is shared through rpilcd_compd
+static int lcd_comp = 0;
+
 int open_lcd_device() {
-    int fd = open("/dev/rpilcd", O_RDWR);
-    if (fd < 0) {
-        printf("Can't open rpilcd driver\n");
+    // other processes may want screen space too, go through the
+    // compositor when it runs
+    int fd = rpilcd_comp_connect(RPILCD_COMP_SOCKET);
+    if (fd >= 0) {
+        lcd_comp = 1;
         return fd;
     }
+    lcd_comp = 0;
+    return open("/dev/rpilcd0", O_RDWR | O_CLOEXEC);
 }
 
 void close_lcd_device(int fd) {
@@ -97,6 +175,40 @@ int print_to_lcd_device(int fd, char* line1, char* line2) {
         printf("Can't print to lcd device. It is closed.\n");
         return fd;
     }
+
+    // both lines at the lowest priority, alerts of other clients go over them
+    if (lcd_comp) {
+        const char *lines[2] = { line1, line2 };
+        if (rpilcd_comp_put(fd, 0, 1, 1, 2, RPILCD_COLS, 0, 0, lines) != 0) {
+            printf("Can't send the lines to rpilcd_compd.\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    // replace the whole screen with one call, if the driver supports it
+    struct rpilcd_frame frame;
+    memset(&frame, 0, sizeof(frame));
+    strncpy(frame.line1, line1, RPILCD_COLS);
+    frame.row = 1;
+    frame.col = strnlen(frame.line1, RPILCD_COLS);
+    if (line2 != NULL) {
+        strncpy(frame.line2, line2, RPILCD_COLS);
+        frame.row = 2;
+        frame.col = strnlen(frame.line2, RPILCD_COLS);
+    }
+    if (frame.col < 1) {
+        frame.col = 1;
+    }
+    if (ioctl(fd, RPILCD_IOC_SET_FRAME, &frame) == 0) {
+        return 0;
+    }
+    if (errno != ENOTTY) {
+        printf("Can't set frame on lcd device.\n");
+        return -1;
+    }
+
+    // older driver, use the escape sequences
     if (write(fd, "\\c", 3) < 0) {
         printf("Can't clear lcd device.\n");
         return -1;
@@ -118,6 +230,212 @@ int print_to_lcd_device(int fd, char* line1, char* line2) {
     return 0;
 }
 
+// ---------------------------------------------------
+// EVENT LOOP
+// ---------------------------------------------------
+
+// one timerfd per job, with its deadline bookkeeping
+struct schedule {
+  const char *name;
+  int fd;
+  int64_t period_us;          // 0 for one-shot timers
+  int64_t deadline;           // next expected expiry
+  unsigned long runs;
+  unsigned long missed;       // expirations that passed without a run
+  int64_t max_late_us;
+};
+
+// measurements taken and failed, to compare the driver with wiringPi
+struct sensor_stats {
+  const char *reader;
+  unsigned long reads;
+  unsigned long failed;
+};
+
+// time from a valid reading until an output shows it
+struct latency {
+  unsigned long count;
+  int64_t total_us;
+  int64_t max_us;
+};
+
+int64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// wall clock time of a sample, for the consumers of the ring
+int64_t wall_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int schedule_arm(struct schedule *s, int64_t delay_us) {
+  struct itimerspec its;
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_sec = delay_us / 1000000;
+  its.it_value.tv_nsec = (delay_us % 1000000) * 1000 + 1;
+  its.it_interval.tv_sec = s->period_us / 1000000;
+  its.it_interval.tv_nsec = (s->period_us % 1000000) * 1000;
+  s->deadline = now_us() + delay_us;
+  return timerfd_settime(s->fd, 0, &its, NULL);
+}
+
+int schedule_init(struct schedule *s, const char *name, int epfd, int64_t period_ms) {
+  struct epoll_event ev;
+  memset(s, 0, sizeof(*s));
+  s->name = name;
+  s->period_us = period_ms * 1000;
+  s->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (s->fd < 0) {
+    return -1;
+  }
+  ev.events = EPOLLIN;
+  ev.data.ptr = s;
+  return epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev);
+}
+
+// consume the expiration, returns 0 when it was spurious
+int schedule_fired(struct schedule *s) {
+  uint64_t expirations = 0;
+  int64_t late;
+
+  if (read(s->fd, &expirations, sizeof(expirations)) != sizeof(expirations) || expirations == 0) {
+    return 0;
+  }
+  late = now_us() - s->deadline;
+  if (late > s->max_late_us) {
+    s->max_late_us = late;
+  }
+  s->missed += expirations - 1;
+  s->runs += 1;
+  s->deadline += s->period_us * (int64_t)expirations;
+  return 1;
+}
+
+void latency_add(struct latency *l, int64_t since) {
+  int64_t us = now_us() - since;
+  l->count += 1;
+  l->total_us += us;
+  if (us > l->max_us) {
+    l->max_us = us;
+  }
+}
+
+void print_report(struct schedule *jobs, int njobs, struct sensor_stats *stats,
+                  struct latency *lcd, struct latency *servo) {
+  for (int i = 0; i < njobs; i++) {
+    printf("[%s] runs: %lu, missed: %lu, max late: %" PRId64 " us\n",
+           jobs[i].name, jobs[i].runs, jobs[i].missed, jobs[i].max_late_us);
+  }
+  printf("[reader] %s, reads: %lu, failed: %lu (%.1f %%)\n", stats->reader, stats->reads,
+         stats->failed, stats->reads ? 100.0 * stats->failed / stats->reads : 0.0);
+  printf("[latency] lcd avg: %" PRId64 " us max: %" PRId64 " us, servo avg: %" PRId64 " us max: %" PRId64 " us\n",
+         lcd->count ? lcd->total_us / (int64_t)lcd->count : 0, lcd->max_us,
+         servo->count ? servo->total_us / (int64_t)servo->count : 0, servo->max_us);
+}
+
+// ---------------------------------------------------
+// SENSOR THREAD
+// ---------------------------------------------------
+// a measurement blocks for 20 ms or more, the start pulse then the bits
+// polled by wiringPi or waited for in the driver, so it runs on its own
+// thread and the event loop keeps the clock line and the servo on time.
+// The loop asks for a measurement with a byte on the request pipe and
+// watches the result pipe in epoll.
+struct sensor_result {
+  int retval;
+  int h;
+  int t;
+  uint32_t decode_us;
+};
+
+struct sensor_thread {
+  pthread_t thread;
+  int dhtfd;
+  int request[2];
+  int result[2];
+};
+
+void *sensor_main(void *arg) {
+  struct sensor_thread *s = arg;
+  struct sensor_result r;
+  char c;
+  ssize_t n;
+
+  // until the loop closes its end of the request pipe
+  while ((n = read(s->request[0], &c, 1)) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    int64_t started = now_us();
+    if (s->dhtfd >= 0) {
+      r.retval = dht11_read_dev(s->dhtfd, &r.h, &r.t);
+    } else {
+      r.retval = dht11_read_val(&r.h, &r.t);
+    }
+    r.decode_us = (uint32_t)(now_us() - started);
+    // smaller than PIPE_BUF, the loop reads it whole
+    if (write(s->result[1], &r, sizeof(r)) != sizeof(r)) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+int sensor_start(struct sensor_thread *s, int dhtfd, int epfd) {
+  struct epoll_event ev;
+  sigset_t mask, old;
+  int ret;
+
+  s->dhtfd = dhtfd;
+  if (pipe2(s->request, O_CLOEXEC) < 0 || pipe2(s->result, O_CLOEXEC | O_NONBLOCK) < 0) {
+    return -1;
+  }
+  ev.events = EPOLLIN;
+  ev.data.ptr = s;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, s->result[0], &ev) < 0) {
+    return -1;
+  }
+  // SIGINT and SIGTERM must reach the loop, not interrupt a measurement
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &mask, &old);
+  ret = pthread_create(&s->thread, NULL, sensor_main, s);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (ret != 0) {
+    errno = ret;
+    return -1;
+  }
+  return 0;
+}
+
+int sensor_request(struct sensor_thread *s) {
+  return write(s->request[1], "r", 1) == 1 ? 0 : -1;
+}
+
+// waits for the measurement in progress, if any
+void sensor_stop(struct sensor_thread *s) {
+  close(s->request[1]);
+  pthread_join(s->thread, NULL);
+  close(s->request[0]);
+  close(s->result[0]);
+  close(s->result[1]);
+}
+
+// stop the loop on SIGINT/SIGTERM so the stored readings get synced
+static volatile sig_atomic_t quit = 0;
+
+void on_quit(int sig) {
+  quit = 1;
+}
+
 // ---------------------------------------------------
 // MAIN FUNCTION
 // ---------------------------------------------------
@@ -126,73 +444,199 @@ int main(int argc, char *argv[]) {
 
   int h; //humidity
   int t; //temperature in degrees Celsius
-  int opt;
-
-
-
 
   // error out if wiringPi can't be used
   if (wiringPiSetup()==-1) {
     printf("Error interfacing with WiringPi\n");
     exit(1);
   }
-  
-  // throw away the first 3 measurements
-  for (int i=0; i<3; i++) {
-    dht11_read_val(&h, &t);
-    delay(3000);
+
+  // a servo daemon going away must not kill us
+  signal(SIGPIPE, SIG_IGN);
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_quit;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  // prefer the kernel driver, it decodes the sensor from edge interrupts
+  int dhtfd = open("/dev/rpidht11", O_RDONLY);
+  if (dhtfd < 0) {
+    printf("Can't open rpidht11 driver, decoding in userspace\n");
   }
-  
-  // Init de lcd_driver device
+
+  // Init de lcd_driver device, without it the display job never runs
   int lcdfd = open_lcd_device();
+  int display = lcdfd >= 0;
+  if (!display) {
+    printf("Can't open rpilcd driver\n");
+  }
+
+  // history of the readings for other processes, see dht11_tail
+  struct dht11_ring *ring = dht11_ring_create(DHT11_RING_NAME);
+  if (ring == NULL) {
+    printf("Can't create sample ring: %s\n", strerror(errno));
+  }
+
+  // long term history on the card, see dht11_query
+  struct dht11_store store;
+  int stored = dht11_store_open(&store, DHT11_STORE_DIR, DHT11_SYNC_INTERVAL) == 0;
+  if (!stored) {
+    printf("Can't open %s: %s\n", DHT11_STORE_DIR, strerror(errno));
+  }
+
+  // sensor sampling, display refresh and servo updates run on their own
+  // timers, so a slow or failing sensor doesn't hold back the clock line
+  enum { SENSOR, DISPLAY, SERVO, REPORT, JOBS };
+  struct schedule jobs[JOBS];
+  struct sensor_thread sensor;
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0 ||
+      schedule_init(&jobs[SENSOR], "sensor", epfd, 0) < 0 ||
+      schedule_init(&jobs[DISPLAY], "display", epfd, DISPLAY_PERIOD) < 0 ||
+      schedule_init(&jobs[SERVO], "servo", epfd, SERVO_PERIOD) < 0 ||
+      schedule_init(&jobs[REPORT], "report", epfd, REPORT_PERIOD) < 0 ||
+      sensor_start(&sensor, dhtfd, epfd) < 0) {
+    perror("event loop");
+    exit(1);
+  }
+  schedule_arm(&jobs[SENSOR], 0);
+  if (display) {
+    schedule_arm(&jobs[DISPLAY], 0);
+  }
+  schedule_arm(&jobs[SERVO], SERVO_PERIOD * 1000);
+  schedule_arm(&jobs[REPORT], REPORT_PERIOD * 1000);
 
-  int retval=1;
-  int tries=0;
+  int discard = 3;          // throw away the first 3 measurements
+  int valid = 0;
+  int tries = 0;
+  int64_t read_at = 0;      // time of the last valid reading
+  int lcd_pending = 0;      // last reading not shown on the LCD yet
+  int servo_pending = 0;    // last reading not sent to the servo yet
+  struct sensor_stats sensor_stats = { dhtfd >= 0 ? "rpidht11" : "wiringPi", 0, 0 };
+  struct latency lcd_latency = {0, 0, 0};
+  struct latency servo_latency = {0, 0, 0};
   char timebuf[17]="\0";
   char valbuf[17]="\0";
-  
-  while(1) {
-    char line[64] = "./servo ";
-    char integer_string[32];
-    sprintf(integer_string, "%d", t);
-    strcat(line, integer_string);
-    //printf(line);
-    system(line);
-    
-
-    // read the sensor until we get a pair of valid measurements
-    // but bail out if we tried too many times
-
-    while (retval != 0 && tries < MAX_TRIES) {
-      retval = dht11_read_val(&h, &t);
-      if (retval == 0) {
+
+  // bail out if the sensor failed too many times in a row
+  while (tries < MAX_TRIES && !quit) {
+    struct epoll_event events[JOBS + 1];
+    int n = epoll_wait(epfd, events, JOBS + 1, -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("epoll_wait");
+      break;
+    }
+
+    for (int e = 0; e < n; e++) {
+      if (events[e].data.ptr == &sensor) {
+        struct sensor_result r;
+        if (read(sensor.result[0], &r, sizeof(r)) != sizeof(r)) {
+          continue;
+        }
+        int retval = r.retval;
+        sensor_stats.reads += 1;
+        sensor_stats.failed += (retval != 0);
+        if (retval == 0 && discard > 0) {
+          discard -= 1;
+          retval = 1;
+          tries = 0;
+        }
+        else if (retval == 0) {
+          h = r.h;
+          t = r.t;
+          if (ring != NULL) {
+            struct dht11_sample sample = { wall_us(), h, t, tries, r.decode_us };
+            dht11_ring_publish(ring, &sample);
+          }
+          if (stored && dht11_store_append(&store, (uint32_t)time(NULL), h, t) != 0) {
+            printf("Can't store reading: %s\n", strerror(errno));
+          }
+          valid = 1;
+          tries = 0;
+          read_at = now_us();
+          lcd_pending = 1;
+          servo_pending = 1;
+          snprintf(valbuf, 17, "Wil: %d,Temp: %d", h, t);
+          printf("%s [%d]\n", valbuf, (int)strlen(valbuf));
+          // show the new values now instead of at the next clock tick
+          if (display) {
+            schedule_arm(&jobs[DISPLAY], 0);
+          }
+        }
+        else {
+          tries += 1;
+        }
+        schedule_arm(&jobs[SENSOR], (retval == 0 ? SENSOR_PERIOD : SENSOR_RETRY) * 1000);
+        continue;
+      }
+
+      struct schedule *job = events[e].data.ptr;
+      if (!schedule_fired(job)) {
+        continue;
+      }
+
+      if (job == &jobs[SENSOR]) {
+        // the result comes back on the sensor pipe, the timer is armed again then
+        if (sensor_request(&sensor) < 0) {
+          perror("sensor request");
+          quit = 1;
+        }
+      }
+      else if (job == &jobs[DISPLAY]) {
         // FIRST LINE ON LCD DEVICE
         time_t current_time = time(NULL);
         struct tm tm = *localtime(&current_time);
         snprintf(timebuf, 17, "Czas: %02d:%02d:%02d", tm.tm_hour, tm.tm_min, tm.tm_sec);
-        //printf("%4d-%02d-%02d,", tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday);
-        //printf("%02d:%02d,", tm.tm_hour, tm.tm_min);
-        printf("%s [%d]\n", timebuf, (int)strlen(timebuf));
 
-        // SECOND LINE ON LCD DEVICE
-        snprintf(valbuf, 17, "Wil: %d,Temp: %d", h, t);
-        printf("%s [%d]\n", valbuf, (int)strlen(valbuf));
+        // the compositor went away: connect again, or use the device
+        if (lcdfd < 0) {
+          lcdfd = open_lcd_device();
+          if (lcdfd < 0) {
+            continue;
+          }
+        }
 
-        print_to_lcd_device(lcdfd, timebuf, valbuf);
-      } else {
-          delay(3000);
+        // SECOND LINE ON LCD DEVICE
+        int shown = print_to_lcd_device(lcdfd, timebuf, valid ? valbuf : NULL) == 0;
+        if (shown && lcd_pending) {
+          lcd_pending = 0;
+          latency_add(&lcd_latency, read_at);
+        }
+        else if (!shown && lcd_comp) {
+          printf("Lost rpilcd_compd, reconnecting.\n");
+          close_lcd_device(lcdfd);
+          lcdfd = -1;
+        }
+      }
+      else if (job == &jobs[SERVO]) {
+        if (servo_pending) {
+          set_servo(t);
+          servo_pending = 0;
+          latency_add(&servo_latency, read_at);
+        }
+      }
+      else if (job == &jobs[REPORT]) {
+        print_report(jobs, JOBS, &sensor_stats, &lcd_latency, &servo_latency);
       }
-      tries += 1;
-    }
-    if (tries < MAX_TRIES) {
-      tries = 0;
-      retval = 1;
-      delay(2000);
-    }
-    else {
-      break;
     }
   }
 
-  close_lcd_device(lcdfd);
+  print_report(jobs, JOBS, &sensor_stats, &lcd_latency, &servo_latency);
+  sensor_stop(&sensor);
+  if (lcdfd >= 0) {
+    close_lcd_device(lcdfd);
+  }
+  if (ring != NULL) {
+    dht11_ring_destroy(ring);
+  }
+  if (stored) {
+    dht11_store_close(&store);
+  }
+  if (dhtfd >= 0) {
+    close(dhtfd);
+  }
 }
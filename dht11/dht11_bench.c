@@ -0,0 +1,406 @@
+// Host benchmark of the DHT11 pulse decoder, no Pi needed.
+//
+// gcc -O2 -o dht11_bench dht11_bench.c dht11_decode.c -std=gnu99
+// ./dht11_bench [-n traces] [-s seed] [-t] [trace files...]
+//
+// Without files it decodes synthetic traces (clean, jittered, truncated,
+// with preemption gaps) for a range of thresholds and prints how many
+// readings come out right, wrong, or rejected, then the decode throughput.
+//
+// Trace files hold one trace per line, durations in microseconds:
+//   <humidity> <temperature> : d0 d1 d2 ...
+//   <short|pulse|checksum> : d0 d1 d2 ...    the error expected
+// or only "d0 d1 d2 ..." when the expected values are unknown.
+// Lines starting with '#' are comments. With -t every trace of the files
+// must decode as expected with the default thresholds, the failures are
+// printed and the exit status is 1 (make test with dht11_traces.txt).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dht11_decode.h"
+
+#define MAX_LEVELS 128
+
+struct trace {
+  int expected;           // 0 when humidity/temperature are unknown
+  enum dht11_status status;   // the error expected instead of a reading
+  int line;
+  uint8_t humidity;
+  uint8_t temperature;
+  size_t count;
+  uint32_t durations[MAX_LEVELS];
+};
+
+enum scenario {
+  CLEAN,
+  JITTER,
+  HEAVY_JITTER,
+  TRUNCATED,
+  PREEMPTED,
+  SCENARIOS
+};
+
+static const char *scenario_names[SCENARIOS] = {
+  "clean", "jitter 8us", "jitter 20us", "truncated", "preempted"
+};
+
+// ---------------------------------------------------
+// SYNTHETIC TRACES
+// ---------------------------------------------------
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void) {
+  // xorshift32, reproducible with -s
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+static uint32_t jitter(uint32_t us, uint32_t amount) {
+  int32_t d;
+  if (amount == 0) {
+    return us;
+  }
+  // sum of two uniforms, most samples near the nominal width
+  d = (int32_t)(rng() % (amount + 1)) + (int32_t)(rng() % (amount + 1)) - (int32_t)amount;
+  if ((int32_t)us + d < 1) {
+    return 1;
+  }
+  return us + d;
+}
+
+static void make_trace(struct trace *tr, enum scenario sc) {
+  uint8_t data[5];
+  uint32_t amount = 0;
+  int bit;
+
+  tr->expected = 1;
+  tr->humidity = 20 + rng() % 70;
+  tr->temperature = rng() % 50;
+  data[0] = tr->humidity;
+  data[1] = 0;
+  data[2] = tr->temperature;
+  data[3] = 0;
+  data[4] = data[0] + data[1] + data[2] + data[3];
+
+  if (sc == JITTER) {
+    amount = 8;
+  }
+  else if (sc == HEAVY_JITTER) {
+    amount = 20;
+  }
+
+  tr->count = 0;
+  tr->durations[tr->count++] = jitter(30, amount);
+  tr->durations[tr->count++] = jitter(80, amount);
+  tr->durations[tr->count++] = jitter(80, amount);
+  for (bit = 0; bit < DHT11_BITS; bit++) {
+    int one = (data[bit / 8] >> (7 - bit % 8)) & 1;
+    tr->durations[tr->count++] = jitter(50, amount);
+    tr->durations[tr->count++] = jitter(one ? 70 : 27, amount);
+  }
+  tr->durations[tr->count++] = jitter(50, amount);
+
+  if (sc == TRUNCATED) {
+    tr->count = 4 + rng() % (tr->count - 4);
+  }
+  else if (sc == PREEMPTED) {
+    // the reader was scheduled out and saw one level last much longer
+    tr->durations[4 + rng() % (tr->count - 5)] += 100 + rng() % 2000;
+  }
+}
+
+// ---------------------------------------------------
+// TRACE FILES
+// ---------------------------------------------------
+static const char *status_names[DHT11_ERR_CHECKSUM + 1] = {
+  "ok", "short", "pulse", "checksum"
+};
+
+// returns the traces of the file, possibly none, or NULL after printing
+// why it could not be read
+static struct trace *load_traces(const char *path, size_t *count) {
+  struct trace *traces;
+  size_t size = 64;
+  char line[4096];
+  char word[16];
+  int number = 0;
+  FILE *f = fopen(path, "r");
+
+  *count = 0;
+  if (f == NULL) {
+    perror(path);
+    return NULL;
+  }
+  traces = malloc(size * sizeof(*traces));
+  if (traces == NULL) {
+    perror(path);
+    fclose(f);
+    return NULL;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    struct trace tr;
+    char *p = line;
+    char *colon = strchr(line, ':');
+    int h, t, st;
+
+    number++;
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+    memset(&tr, 0, sizeof(tr));
+    tr.line = number;
+    if (colon != NULL) {
+      if (sscanf(line, "%d %d", &h, &t) == 2) {
+        tr.expected = 1;
+        tr.humidity = h;
+        tr.temperature = t;
+      }
+      else if (sscanf(line, "%15s", word) == 1) {
+        for (st = DHT11_ERR_SHORT; st <= DHT11_ERR_CHECKSUM; st++) {
+          if (strcmp(word, status_names[st]) == 0) {
+            tr.expected = 1;
+            tr.status = st;
+          }
+        }
+      }
+      p = colon + 1;
+    }
+    while (tr.count < MAX_LEVELS) {
+      char *end;
+      unsigned long d = strtoul(p, &end, 10);
+      if (end == p) {
+        break;
+      }
+      tr.durations[tr.count++] = d;
+      p = end;
+    }
+    if (*count == size) {
+      struct trace *grown = realloc(traces, 2 * size * sizeof(*traces));
+      if (grown == NULL) {
+        perror(path);
+        free(traces);
+        fclose(f);
+        return NULL;
+      }
+      traces = grown;
+      size *= 2;
+    }
+    traces[(*count)++] = tr;
+  }
+  if (ferror(f)) {
+    perror(path);
+    free(traces);
+    fclose(f);
+    return NULL;
+  }
+  fclose(f);
+  return traces;
+}
+
+// ---------------------------------------------------
+// BENCHMARK
+// ---------------------------------------------------
+struct result {
+  size_t right;
+  size_t wrong;           // passed the checksum with the wrong value
+  size_t rejected[DHT11_ERR_CHECKSUM + 1];
+};
+
+static void run(const struct trace *traces, size_t count, const struct dht11_decode_cfg *cfg,
+                struct result *res) {
+  size_t i;
+  memset(res, 0, sizeof(*res));
+  for (i = 0; i < count; i++) {
+    struct dht11_reading reading;
+    enum dht11_status st = dht11_decode(traces[i].durations, traces[i].count, cfg, &reading);
+    if (st != DHT11_OK) {
+      res->rejected[st]++;
+    }
+    else if (traces[i].expected && (traces[i].status != DHT11_OK ||
+                                    reading.humidity != traces[i].humidity ||
+                                    reading.temperature != traces[i].temperature)) {
+      res->wrong++;
+    }
+    else {
+      res->right++;
+    }
+  }
+}
+
+// every trace with an expectation must meet it, returns the failures
+static size_t check(const char *path, const struct trace *traces, size_t count,
+                    const struct dht11_decode_cfg *cfg) {
+  size_t failures = 0;
+  size_t i;
+  for (i = 0; i < count; i++) {
+    const struct trace *tr = &traces[i];
+    struct dht11_reading reading;
+    enum dht11_status st;
+    if (!tr->expected) {
+      continue;
+    }
+    st = dht11_decode(tr->durations, tr->count, cfg, &reading);
+    if (st != tr->status) {
+      printf("%s:%d: expected %s, got %s\n", path, tr->line, status_names[tr->status],
+             status_names[st]);
+      failures++;
+    }
+    else if (st == DHT11_OK && (reading.humidity != tr->humidity ||
+                                reading.temperature != tr->temperature)) {
+      printf("%s:%d: expected %u %u, got %u %u\n", path, tr->line, tr->humidity,
+             tr->temperature, reading.humidity, reading.temperature);
+      failures++;
+    }
+  }
+  return failures;
+}
+
+static void print_header(void) {
+  printf("%-14s %5s %5s %8s %8s %8s %8s %8s\n",
+         "traces", "thr", "max", "right%", "wrong%", "short%", "pulse%", "csum%");
+}
+
+static void print_result(const char *name, const struct dht11_decode_cfg *cfg,
+                         const struct result *res, size_t count) {
+  double n = count ? (double)count / 100.0 : 1.0;
+  printf("%-14s %5u %5u %8.2f %8.2f %8.2f %8.2f %8.2f\n", name,
+         cfg->threshold, cfg->max_pulse, res->right / n, res->wrong / n,
+         res->rejected[DHT11_ERR_SHORT] / n, res->rejected[DHT11_ERR_PULSE] / n,
+         res->rejected[DHT11_ERR_CHECKSUM] / n);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void throughput(const struct trace *traces, size_t count) {
+  const struct dht11_decode_cfg cfg = DHT11_DECODE_MICROS;
+  volatile unsigned sink = 0;
+  size_t decodes = 0;
+  double start = now();
+  double elapsed;
+
+  do {
+    size_t i;
+    for (i = 0; i < count; i++) {
+      struct dht11_reading reading;
+      sink += dht11_decode(traces[i].durations, traces[i].count, &cfg, &reading);
+    }
+    decodes += count;
+    elapsed = now() - start;
+  } while (elapsed < 1.0);
+
+  printf("\nthroughput: %.0f decodes/s, %.1f ns/decode\n",
+         decodes / elapsed, elapsed * 1e9 / decodes);
+}
+
+int main(int argc, char *argv[]) {
+  const struct dht11_decode_cfg defaults = DHT11_DECODE_MICROS;
+  size_t count = 10000;
+  int test = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:t")) != -1) {
+    switch (opt) {
+      case 'n':
+        count = strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        rng_state = strtoul(optarg, NULL, 10) | 1;
+        break;
+      case 't':
+        test = 1;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n traces] [-s seed] [-t] [trace files...]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (count == 0) {
+    count = 1;
+  }
+
+  if (test) {
+    size_t total = 0, failures = 0;
+    if (optind == argc) {
+      fprintf(stderr, "-t needs trace files\n");
+      return 1;
+    }
+    for (; optind < argc; optind++) {
+      size_t loaded;
+      struct trace *traces = load_traces(argv[optind], &loaded);
+      if (traces == NULL) {
+        return 1;
+      }
+      total += loaded;
+      failures += check(argv[optind], traces, loaded, &defaults);
+      free(traces);
+    }
+    // a test without traces checks nothing, don't let it pass
+    if (total == 0) {
+      fprintf(stderr, "no traces in the files\n");
+      return 1;
+    }
+    printf("%zu traces, %zu failures\n", total, failures);
+    return failures != 0;
+  }
+
+  print_header();
+  if (optind < argc) {
+    for (; optind < argc; optind++) {
+      struct result res;
+      size_t loaded;
+      struct trace *traces = load_traces(argv[optind], &loaded);
+      if (traces == NULL) {
+        continue;
+      }
+      if (loaded == 0) {
+        printf("%s: no traces\n", argv[optind]);
+        free(traces);
+        continue;
+      }
+      run(traces, loaded, &defaults, &res);
+      print_result(argv[optind], &defaults, &res, loaded);
+      throughput(traces, loaded);
+      free(traces);
+    }
+    return 0;
+  }
+
+  struct trace *traces = malloc(count * sizeof(*traces));
+  enum scenario sc;
+  for (sc = 0; sc < SCENARIOS; sc++) {
+    uint32_t threshold;
+    size_t i;
+    for (i = 0; i < count; i++) {
+      make_trace(&traces[i], sc);
+    }
+    for (threshold = 36; threshold <= 60; threshold += 6) {
+      struct dht11_decode_cfg cfg = defaults;
+      struct result res;
+      cfg.threshold = threshold;
+      cfg.max_pulse = 0;
+      run(traces, count, &cfg, &res);
+      print_result(scenario_names[sc], &cfg, &res, count);
+      cfg.max_pulse = defaults.max_pulse;
+      run(traces, count, &cfg, &res);
+      print_result(scenario_names[sc], &cfg, &res, count);
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    make_trace(&traces[i], JITTER);
+  }
+  throughput(traces, count);
+  free(traces);
+  return 0;
+}
@@ -0,0 +1,64 @@
+#include "dht11_decode.h"
+
+// ---------------------------------------------------
+// DHT11 PULSE DECODER
+// ---------------------------------------------------
+
+enum dht11_status dht11_decode(const uint32_t *durations, size_t count,
+                               const struct dht11_decode_cfg *cfg,
+                               struct dht11_reading *reading) {
+  uint8_t data[DHT11_BITS / 8] = {0, 0, 0, 0, 0};
+  size_t bit = 0;
+  size_t i;
+
+  for (i = cfg->first_bit; i < count && bit < DHT11_BITS; i += 2) {
+    // the low level before a bit is always 50 us, only check it for gaps
+    if (cfg->max_pulse != 0 && (durations[i] > cfg->max_pulse ||
+                                (i > 0 && durations[i - 1] > cfg->max_pulse))) {
+      return DHT11_ERR_PULSE;
+    }
+    data[bit / 8] <<= 1;
+    if (durations[i] > cfg->threshold) {
+      data[bit / 8] |= 1;
+    }
+    bit++;
+  }
+
+  if (bit < DHT11_BITS) {
+    return DHT11_ERR_SHORT;
+  }
+  if (data[4] != ((data[0] + data[1] + data[2] + data[3]) & 0xFF)) {
+    return DHT11_ERR_CHECKSUM;
+  }
+
+  reading->humidity = data[0];
+  reading->humidity_dec = data[1];
+  reading->temperature = data[2];
+  reading->temperature_dec = data[3];
+  return DHT11_OK;
+}
+
+size_t dht11_edges_to_durations(const uint32_t *edges, size_t count, uint32_t *durations) {
+  size_t i;
+  if (count < 2) {
+    return 0;
+  }
+  for (i = 0; i + 1 < count; i++) {
+    durations[i] = edges[i + 1] - edges[i];
+  }
+  return count - 1;
+}
+
+const char *dht11_strerror(enum dht11_status status) {
+  switch (status) {
+    case DHT11_OK:
+      return "ok";
+    case DHT11_ERR_SHORT:
+      return "trace too short";
+    case DHT11_ERR_PULSE:
+      return "pulse too long";
+    case DHT11_ERR_CHECKSUM:
+      return "checksum mismatch";
+  }
+  return "unknown";
+}
@@ -0,0 +1,57 @@
+#ifndef DHT11_DECODE_H_
+#define DHT11_DECODE_H_
+/*
+ * DHT11 pulse decoder, independent of wiringPi and of the way the pulses
+ * were captured. Input is the duration of every level on the data line
+ * after the host released it, in any unit (microseconds, loop counts...),
+ * as long as the thresholds in struct dht11_decode_cfg use the same unit.
+ *
+ * durations[0]   high, host release until the sensor answers
+ * durations[1]   low  80 us, response
+ * durations[2]   high 80 us, response
+ * durations[3]   low  50 us, start of bit 1
+ * durations[4]   high 26-28 us (0) or 70 us (1), bit 1
+ * ...            low/high pairs for bits 2..40
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#define DHT11_BITS      40
+/* levels in a complete transmission, durations[] needs at least that many */
+#define DHT11_LEVELS    (4 + 2 * DHT11_BITS - 1)
+
+enum dht11_status {
+  DHT11_OK = 0,
+  DHT11_ERR_SHORT,        /* less than 40 bits in the trace */
+  DHT11_ERR_PULSE,        /* a data pulse longer than max_pulse */
+  DHT11_ERR_CHECKSUM,     /* checksum does not match */
+};
+
+struct dht11_decode_cfg {
+  size_t   first_bit;     /* index of the high level of bit 1 */
+  uint32_t threshold;     /* high level longer than this is a 1 */
+  uint32_t max_pulse;     /* longer data pulse is an error, 0 = no check */
+};
+
+/* wiringPi loop counts in dht11_read_val: the top 3 transitions are ignored */
+#define DHT11_DECODE_COUNTER    { 4, 16, 0 }
+/* durations in microseconds */
+#define DHT11_DECODE_MICROS     { 4, 48, 120 }
+
+struct dht11_reading {
+  uint8_t humidity;
+  uint8_t humidity_dec;
+  uint8_t temperature;
+  uint8_t temperature_dec;
+};
+
+enum dht11_status dht11_decode(const uint32_t *durations, size_t count,
+                               const struct dht11_decode_cfg *cfg,
+                               struct dht11_reading *reading);
+
+/* durations[i] = edges[i+1] - edges[i], returns count - 1 */
+size_t dht11_edges_to_durations(const uint32_t *edges, size_t count, uint32_t *durations);
+
+const char *dht11_strerror(enum dht11_status status);
+
+#endif //DHT11_DECODE_H_
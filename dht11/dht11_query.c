@@ -0,0 +1,130 @@
+// Minimum, maximum and average of the stored DHT11 readings.
+//
+// gcc -O2 -o dht11_query dht11_query.c dht11_store.c -std=gnu99
+// ./dht11_query [-d dir] [-f from] [-t to] [-s step]
+//
+// Times are seconds since the epoch, "now", or a duration before now
+// such as 90s, 30m, 12h or 7d. The default is the last day as a single
+// window, -s splits it in windows of that length, e.g. -f 30d -s 1d for
+// one line per day of the last month:
+//   <start> count <n> humidity <min> <avg> <max> temperature <min> <avg> <max>
+// Readings reach the store at the sync interval of dht11_back, the last
+// ones are in the shared ring (dht11_tail).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "dht11_store.h"
+
+static int parse_time(const char *arg, uint32_t now, int duration, uint32_t *out) {
+  char *end;
+  unsigned long v;
+
+  if (strcmp(arg, "now") == 0) {
+    *out = now;
+    return 0;
+  }
+  v = strtoul(arg, &end, 10);
+  if (end == arg) {
+    return -1;
+  }
+  switch (*end) {
+    case 'd':
+      v *= 24;
+      // fall through
+    case 'h':
+      v *= 60;
+      // fall through
+    case 'm':
+      v *= 60;
+      // fall through
+    case 's':
+      end++;
+      break;
+    case '\0':
+      // a plain number is a time, or a step in seconds
+      *out = (uint32_t)v;
+      return 0;
+    default:
+      return -1;
+  }
+  if (*end != '\0') {
+    return -1;
+  }
+  *out = duration ? (uint32_t)v : now - (uint32_t)v;
+  return 0;
+}
+
+static void print_stats(uint32_t start, const struct dht11_stats *s) {
+  time_t sec = start;
+  struct tm tm = *localtime(&sec);
+  char when[32];
+  strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+  if (s->count == 0) {
+    printf("%s count 0\n", when);
+    return;
+  }
+  printf("%s count %" PRIu64 " humidity %u %.1f %u temperature %u %.1f %u\n", when, s->count,
+         s->min_humidity, (double)s->sum_humidity / s->count, s->max_humidity,
+         s->min_temperature, (double)s->sum_temperature / s->count, s->max_temperature);
+}
+
+int main(int argc, char *argv[]) {
+  const char *dir = DHT11_STORE_DIR;
+  const uint32_t now = (uint32_t)time(NULL);
+  uint32_t from = now - 24 * 3600;
+  uint32_t to = now;
+  uint32_t step = 0;
+  struct dht11_stats *stats;
+  size_t windows;
+  int opt, ok = 1;
+
+  while ((opt = getopt(argc, argv, "d:f:t:s:")) != -1) {
+    switch (opt) {
+      case 'd':
+        dir = optarg;
+        break;
+      case 'f':
+        ok = ok && parse_time(optarg, now, 0, &from) == 0;
+        break;
+      case 't':
+        ok = ok && parse_time(optarg, now, 0, &to) == 0;
+        break;
+      case 's':
+        ok = ok && parse_time(optarg, now, 1, &step) == 0;
+        break;
+      default:
+        ok = 0;
+        break;
+    }
+  }
+  if (!ok || to <= from) {
+    fprintf(stderr, "usage: %s [-d dir] [-f from] [-t to] [-s step]\n", argv[0]);
+    return 1;
+  }
+  if (step == 0 || step > to - from) {
+    step = to - from;
+  }
+
+  windows = ((size_t)to - from + step - 1) / step;
+  stats = calloc(windows, sizeof(*stats));
+  if (stats == NULL) {
+    perror("dht11_query");
+    return 1;
+  }
+  if (dht11_store_query(dir, from, step, windows, stats) != 0) {
+    perror(dir);
+    free(stats);
+    return 1;
+  }
+  for (size_t i = 0; i < windows; i++) {
+    print_stats(from + (uint32_t)i * step, &stats[i]);
+  }
+  free(stats);
+  return 0;
+}
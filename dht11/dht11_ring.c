@@ -0,0 +1,199 @@
+#include "dht11_ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// the producer keeps its descriptor open to hold the lock
+static int producer_fd = -1;
+
+// ---------------------------------------------------
+// MAPPING
+// ---------------------------------------------------
+
+// maps the segment of fd when it holds a ring of this layout
+static struct dht11_ring *map_existing(int fd) {
+  struct dht11_ring *ring;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size != sizeof(*ring)) {
+    return NULL;
+  }
+  ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ring == MAP_FAILED) {
+    return NULL;
+  }
+  if (ring->magic != DHT11_RING_MAGIC || ring->version != DHT11_RING_VERSION ||
+      ring->slots != DHT11_RING_SLOTS) {
+    munmap(ring, sizeof(*ring));
+    return NULL;
+  }
+  return ring;
+}
+
+// a new segment under name, consumers of the one it replaces keep theirs
+static struct dht11_ring *map_new(const char *name, int *pfd) {
+  struct dht11_ring *ring;
+  int fd;
+
+  if (shm_unlink(name) != 0 && errno != ENOENT) {
+    return NULL;
+  }
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return NULL;
+  }
+  // another producer may have opened it in between
+  if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+    close(fd);
+    errno = EBUSY;
+    return NULL;
+  }
+  if (ftruncate(fd, sizeof(*ring)) != 0) {
+    close(fd);
+    return NULL;
+  }
+  ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ring == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  ring->version = DHT11_RING_VERSION;
+  ring->slots = DHT11_RING_SLOTS;
+  __atomic_store_n(&ring->magic, DHT11_RING_MAGIC, __ATOMIC_RELEASE);
+  *pfd = fd;
+  return ring;
+}
+
+struct dht11_ring *dht11_ring_create(const char *name) {
+  struct dht11_ring *ring;
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+    close(fd);
+    errno = EBUSY;
+    return NULL;
+  }
+
+  // keep the history of a previous run when the layout is the same. A
+  // segment of another size or layout may still be mapped by consumers,
+  // resizing or clearing it would fault them or feed them garbage: it is
+  // replaced instead. Our lock on it keeps other producers out meanwhile.
+  ring = map_existing(fd);
+  if (ring == NULL) {
+    int new_fd = -1;
+    ring = map_new(name, &new_fd);
+    close(fd);
+    if (ring == NULL) {
+      return NULL;
+    }
+    fd = new_fd;
+  }
+  producer_fd = fd;
+  return ring;
+}
+
+const struct dht11_ring *dht11_ring_open(const char *name) {
+  const struct dht11_ring *ring;
+  struct stat st;
+  int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(*ring)) {
+    close(fd);
+    errno = ENODATA;
+    return NULL;
+  }
+  ring = mmap(NULL, sizeof(*ring), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ring == MAP_FAILED) {
+    return NULL;
+  }
+  if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != DHT11_RING_MAGIC ||
+      ring->version != DHT11_RING_VERSION || ring->slots != DHT11_RING_SLOTS) {
+    munmap((void *)ring, sizeof(*ring));
+    errno = EPROTO;
+    return NULL;
+  }
+  return ring;
+}
+
+void dht11_ring_close(const struct dht11_ring *ring) {
+  munmap((void *)ring, sizeof(*ring));
+}
+
+void dht11_ring_destroy(struct dht11_ring *ring) {
+  munmap(ring, sizeof(*ring));
+  if (producer_fd >= 0) {
+    close(producer_fd);
+    producer_fd = -1;
+  }
+}
+
+// ---------------------------------------------------
+// PRODUCER
+// ---------------------------------------------------
+void dht11_ring_publish(struct dht11_ring *ring, const struct dht11_sample *sample) {
+  const uint32_t n = ring->head;
+  struct dht11_ring_slot *slot = &ring->slot[n % DHT11_RING_SLOTS];
+
+  // odd while writing, readers of the old sample see it changed
+  __atomic_store_n(&slot->seq, 2 * n + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  slot->sample = *sample;
+  __atomic_store_n(&slot->seq, 2 * (n + 1), __ATOMIC_RELEASE);
+  __atomic_store_n(&ring->head, n + 1, __ATOMIC_RELEASE);
+}
+
+// ---------------------------------------------------
+// CONSUMERS
+// ---------------------------------------------------
+uint32_t dht11_ring_head(const struct dht11_ring *ring) {
+  return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+}
+
+// copy sample n, fails when the producer has overwritten it
+static int read_slot(const struct dht11_ring *ring, uint32_t n, struct dht11_sample *sample) {
+  const struct dht11_ring_slot *slot = &ring->slot[n % DHT11_RING_SLOTS];
+  uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+  if (seq != 2 * (n + 1)) {
+    return 0;
+  }
+  *sample = slot->sample;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq;
+}
+
+int dht11_ring_next(const struct dht11_ring *ring, uint32_t *cursor,
+                    struct dht11_sample *sample, uint32_t *lost) {
+  uint32_t head = dht11_ring_head(ring);
+  uint32_t skipped = 0;
+  int found = 0;
+
+  // counters are free running, the differences survive a wrap
+  if ((int32_t)(head - *cursor) < 0) {
+    // the ring was created again, follow it from its head
+    *cursor = head;
+  }
+  else if (head - *cursor > DHT11_RING_SLOTS) {
+    skipped += head - DHT11_RING_SLOTS - *cursor;
+    *cursor = head - DHT11_RING_SLOTS;
+  }
+  while (*cursor != head && !found) {
+    found = read_slot(ring, *cursor, sample);
+    if (!found) {
+      skipped++;
+    }
+    *cursor += 1;
+    head = dht11_ring_head(ring);
+  }
+  if (lost != NULL) {
+    *lost += skipped;
+  }
+  return found;
+}
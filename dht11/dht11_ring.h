@@ -0,0 +1,77 @@
+#ifndef DHT11_RING_H_
+#define DHT11_RING_H_
+/*
+ * History of the validated DHT11 readings in POSIX shared memory
+ * (/dev/shm/dht11_samples). dht11_back is the only producer, any number
+ * of processes map it read-only and follow it without system calls and
+ * without touching the sensor.
+ *
+ * The ring is lock-free: every slot carries a sequence number which is
+ * odd while the producer writes it and 2 * (n + 1) once it holds sample
+ * n. A consumer copies the slot and checks the sequence again, so a
+ * sample overwritten during the copy is detected instead of read torn.
+ * The producer never waits for the consumers; one falling behind by more
+ * than DHT11_RING_SLOTS samples loses the oldest ones.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#define DHT11_RING_NAME     "/dht11_samples"
+#define DHT11_RING_MAGIC    0x31544844u     /* "DHT1" */
+#define DHT11_RING_VERSION  1
+#define DHT11_RING_SLOTS    1024            /* power of two */
+
+struct dht11_sample {
+  int64_t  time_us;       /* CLOCK_REALTIME of the reading */
+  uint8_t  humidity;
+  uint8_t  temperature;
+  uint16_t retries;       /* failed reads since the previous valid one */
+  uint32_t decode_us;     /* time to read and decode the sensor */
+};
+
+struct dht11_ring_slot {
+  uint32_t seq;
+  uint32_t reserved;
+  struct dht11_sample sample;
+};
+
+struct dht11_ring {
+  uint32_t magic;         /* written last when the ring is created */
+  uint32_t version;
+  uint32_t slots;
+  uint32_t head;          /* samples published so far */
+  struct dht11_ring_slot slot[DHT11_RING_SLOTS];
+};
+
+/*
+ * Map the ring. The producer creates it, or continues an existing one of
+ * the same layout, and holds a lock so a second producer fails with
+ * EBUSY; a segment of another layout is unlinked and replaced, never
+ * resized under its consumers. Consumers map it read-only. Returns NULL
+ * with errno set on failure.
+ *
+ * Consumers unmap with dht11_ring_close(), the producer with
+ * dht11_ring_destroy() which also drops its lock. The segment stays for
+ * the consumers and the next run.
+ */
+struct dht11_ring *dht11_ring_create(const char *name);
+const struct dht11_ring *dht11_ring_open(const char *name);
+void dht11_ring_close(const struct dht11_ring *ring);
+void dht11_ring_destroy(struct dht11_ring *ring);
+
+/* producer side */
+void dht11_ring_publish(struct dht11_ring *ring, const struct dht11_sample *sample);
+
+/* number of samples published so far */
+uint32_t dht11_ring_head(const struct dht11_ring *ring);
+
+/*
+ * Next sample after *cursor, which starts at 0 or at dht11_ring_head()
+ * to only follow new samples. Returns 1 and advances the cursor when a
+ * sample was copied, 0 when there is nothing new. Samples overwritten
+ * before they could be read are skipped and added to *lost if not NULL.
+ */
+int dht11_ring_next(const struct dht11_ring *ring, uint32_t *cursor,
+                    struct dht11_sample *sample, uint32_t *lost);
+
+#endif //DHT11_RING_H_
@@ -0,0 +1,389 @@
+#include "dht11_store.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ---------------------------------------------------
+// SEGMENTS
+// ---------------------------------------------------
+static int is_segment(const struct dirent *d) {
+  size_t len = strlen(d->d_name);
+  return len == 14 && strcmp(d->d_name + 10, ".dts") == 0;
+}
+
+// segment names sorted by time, which is also their name order
+static int list_segments(const char *dir, struct dirent ***names) {
+  return scandir(dir, names, is_segment, alphasort);
+}
+
+static void free_segments(struct dirent **names, int n) {
+  for (int i = 0; i < n; i++) {
+    free(names[i]);
+  }
+  free(names);
+}
+
+static int segment_path(char *path, size_t size, const char *dir, uint32_t time) {
+  if (snprintf(path, size, "%s/%010u.dts", dir, time) >= (int)size) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  return 0;
+}
+
+// time of the last record of a block, and its number of records
+static uint32_t block_end(const struct dht11_block *b, uint32_t *records) {
+  uint32_t time = b->first_time;
+  uint32_t i;
+  for (i = 0; i < DHT11_BLOCK_RECORDS && b->record[i].delta != 0; i++) {
+    time += b->record[i].delta - 1;
+  }
+  *records = i;
+  return time;
+}
+
+// ---------------------------------------------------
+// WRITER
+// ---------------------------------------------------
+static int write_block(struct dht11_store *store) {
+  const off_t offset = (off_t)store->block * DHT11_BLOCK_SIZE;
+  if (pwrite(store->fd, &store->current, DHT11_BLOCK_SIZE, offset) != DHT11_BLOCK_SIZE) {
+    return -1;
+  }
+  store->dirty = 0;
+  return 0;
+}
+
+static int new_segment(struct dht11_store *store, uint32_t time) {
+  char path[300];
+  int dirfd;
+
+  if (segment_path(path, sizeof(path), store->dir, time) != 0) {
+    return -1;
+  }
+  store->fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (store->fd < 0) {
+    return -1;
+  }
+  // reserve the whole segment now, appending never changes the file size
+  if (posix_fallocate(store->fd, 0, DHT11_SEGMENT_SIZE) != 0 &&
+      ftruncate(store->fd, DHT11_SEGMENT_SIZE) != 0) {
+    close(store->fd);
+    store->fd = -1;
+    return -1;
+  }
+  // the new name must survive a power cut as well
+  dirfd = open(store->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirfd >= 0) {
+    fsync(dirfd);
+    close(dirfd);
+  }
+  store->block = 0;
+  store->records = 0;
+  memset(&store->current, 0, sizeof(store->current));
+  return 0;
+}
+
+// continue in the last block written by a previous run
+static int resume(struct dht11_store *store, const char *name) {
+  char path[300];
+  struct dht11_block block;
+  uint32_t i;
+
+  if (snprintf(path, sizeof(path), "%s/%s", store->dir, name) >= (int)sizeof(path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  store->fd = open(path, O_RDWR | O_CLOEXEC);
+  if (store->fd < 0) {
+    return -1;
+  }
+  for (i = 0; i < DHT11_SEGMENT_BLOCKS; i++) {
+    if (pread(store->fd, &block, sizeof(block), (off_t)i * DHT11_BLOCK_SIZE) != sizeof(block) ||
+        block.magic != DHT11_BLOCK_MAGIC) {
+      break;
+    }
+    store->current = block;
+  }
+  if (i == 0) {
+    // created but nothing written yet
+    store->block = 0;
+    store->records = 0;
+    memset(&store->current, 0, sizeof(store->current));
+    store->last_time = (uint32_t)strtoul(name, NULL, 10);
+    return 0;
+  }
+  store->block = i - 1;
+  store->last_time = block_end(&store->current, &store->records);
+  return 0;
+}
+
+int dht11_store_open(struct dht11_store *store, const char *dir, uint32_t sync_interval) {
+  struct dirent **names;
+  int n;
+
+  memset(store, 0, sizeof(*store));
+  store->fd = -1;
+  store->sync_interval = sync_interval;
+  if (snprintf(store->dir, sizeof(store->dir), "%s", dir) >= (int)sizeof(store->dir)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    return -1;
+  }
+  n = list_segments(dir, &names);
+  if (n < 0) {
+    return -1;
+  }
+  if (n > 0 && resume(store, names[n - 1]->d_name) != 0) {
+    free_segments(names, n);
+    return -1;
+  }
+  free_segments(names, n);
+  store->synced_time = store->last_time;
+  return 0;
+}
+
+int dht11_store_append(struct dht11_store *store, uint32_t time, uint8_t humidity,
+                       uint8_t temperature) {
+  struct dht11_record *record;
+
+  // the clock stepped back, keep the records in order
+  if (store->fd >= 0 && time < store->last_time) {
+    time = store->last_time;
+  }
+
+  if (store->fd < 0) {
+    if (new_segment(store, time) != 0) {
+      return -1;
+    }
+  }
+  else if (store->records == DHT11_BLOCK_RECORDS ||
+           (store->records > 0 && time - store->last_time > DHT11_MAX_DELTA)) {
+    // the block is full, or the gap does not fit in a delta
+    if (store->dirty && write_block(store) != 0) {
+      return -1;
+    }
+    if (store->block + 1 == DHT11_SEGMENT_BLOCKS) {
+      if (dht11_store_sync(store) != 0) {
+        return -1;
+      }
+      close(store->fd);
+      if (new_segment(store, time) != 0) {
+        return -1;
+      }
+    }
+    else {
+      store->block += 1;
+      store->records = 0;
+      memset(&store->current, 0, sizeof(store->current));
+    }
+  }
+
+  if (store->records == 0) {
+    store->current.magic = DHT11_BLOCK_MAGIC;
+    store->current.first_time = time;
+    store->last_time = time;
+  }
+  record = &store->current.record[store->records];
+  record->delta = (uint16_t)(time - store->last_time + 1);
+  record->humidity = humidity;
+  record->temperature = temperature;
+  store->records += 1;
+  store->last_time = time;
+  store->dirty = 1;
+
+  // a full block goes to the page cache at once, the card waits for the sync
+  if (store->records == DHT11_BLOCK_RECORDS && write_block(store) != 0) {
+    return -1;
+  }
+  if (time - store->synced_time >= store->sync_interval) {
+    return dht11_store_sync(store);
+  }
+  return 0;
+}
+
+int dht11_store_sync(struct dht11_store *store) {
+  if (store->fd < 0) {
+    return 0;
+  }
+  if (store->dirty && write_block(store) != 0) {
+    return -1;
+  }
+  if (fdatasync(store->fd) != 0) {
+    return -1;
+  }
+  store->synced_time = store->last_time;
+  return 0;
+}
+
+void dht11_store_close(struct dht11_store *store) {
+  if (store->fd >= 0) {
+    dht11_store_sync(store);
+    close(store->fd);
+    store->fd = -1;
+  }
+}
+
+// ---------------------------------------------------
+// QUERY
+// ---------------------------------------------------
+struct window_set {
+  uint32_t from;
+  uint32_t step;
+  uint64_t end;
+  size_t windows;
+  struct dht11_stats *stats;
+};
+
+static void add_reading(struct window_set *w, uint32_t time, const struct dht11_record *r) {
+  struct dht11_stats *s = &w->stats[(time - w->from) / w->step];
+  if (s->count == 0) {
+    s->first_time = time;
+  }
+  s->last_time = time;
+  s->count += 1;
+  s->sum_humidity += r->humidity;
+  s->sum_temperature += r->temperature;
+  if (r->humidity < s->min_humidity) {
+    s->min_humidity = r->humidity;
+  }
+  if (r->humidity > s->max_humidity) {
+    s->max_humidity = r->humidity;
+  }
+  if (r->temperature < s->min_temperature) {
+    s->min_temperature = r->temperature;
+  }
+  if (r->temperature > s->max_temperature) {
+    s->max_temperature = r->temperature;
+  }
+}
+
+// returns 1 once the segment goes past the last window
+static int query_segment(const struct dht11_block *blocks, uint32_t used, struct window_set *w) {
+  uint32_t lo = 0, hi = used;
+  uint32_t b;
+
+  // last block starting before the first window, the earlier ones end before it
+  while (hi - lo > 1) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (blocks[mid].first_time < w->from) {
+      lo = mid;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  for (b = lo; b < used; b++) {
+    const struct dht11_block *block = &blocks[b];
+    uint32_t time = block->first_time;
+    if (time >= w->end) {
+      return 1;
+    }
+    for (uint32_t i = 0; i < DHT11_BLOCK_RECORDS && block->record[i].delta != 0; i++) {
+      time += block->record[i].delta - 1;
+      if (time >= w->end) {
+        return 1;
+      }
+      if (time >= w->from) {
+        add_reading(w, time, &block->record[i]);
+      }
+    }
+  }
+  return 0;
+}
+
+static int query_file(const char *dir, const char *name, struct window_set *w, int *done) {
+  const struct dht11_block *blocks;
+  char path[300];
+  struct stat st;
+  uint32_t used, lo, hi;
+  int fd;
+
+  if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+  if (st.st_size < DHT11_BLOCK_SIZE) {
+    close(fd);
+    return 0;
+  }
+  blocks = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (blocks == MAP_FAILED) {
+    return -1;
+  }
+
+  // the written blocks are a prefix of the segment
+  lo = 0;
+  hi = (uint32_t)(st.st_size / DHT11_BLOCK_SIZE);
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (blocks[mid].magic == DHT11_BLOCK_MAGIC) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  used = lo;
+  if (used > 0) {
+    *done = query_segment(blocks, used, w);
+  }
+  munmap((void *)blocks, st.st_size);
+  return 0;
+}
+
+int dht11_store_query(const char *dir, uint32_t from, uint32_t step, size_t windows,
+                      struct dht11_stats *stats) {
+  struct window_set w = { from, step, (uint64_t)from + (uint64_t)step * windows, windows, stats };
+  struct dirent **names;
+  int n, done = 0;
+  int ret = 0;
+
+  if (step == 0 || windows == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (w.end > UINT32_MAX) {
+    w.end = UINT32_MAX;
+  }
+  for (size_t i = 0; i < windows; i++) {
+    memset(&stats[i], 0, sizeof(stats[i]));
+    stats[i].min_humidity = UINT8_MAX;
+    stats[i].min_temperature = UINT8_MAX;
+  }
+
+  n = list_segments(dir, &names);
+  if (n < 0) {
+    return -1;
+  }
+  for (int i = 0; i < n && !done; i++) {
+    // a segment ends where the next one starts
+    if (i + 1 < n && strtoul(names[i + 1]->d_name, NULL, 10) < from) {
+      continue;
+    }
+    if (query_file(dir, names[i]->d_name, &w, &done) != 0) {
+      ret = -1;
+      break;
+    }
+  }
+  free_segments(names, n);
+  return ret;
+}
@@ -0,0 +1,90 @@
+#ifndef DHT11_STORE_H_
+#define DHT11_STORE_H_
+/*
+ * Append-only binary storage of the DHT11 readings, sized for an SD card.
+ *
+ * A directory holds segments of DHT11_SEGMENT_BLOCKS blocks, named after
+ * the time of their first reading (%010u.dts), preallocated so appending
+ * never changes the file size. A block is DHT11_BLOCK_SIZE bytes:
+ *
+ *   magic, time of the first record (seconds since the epoch)
+ *   records of 4 bytes: delta + 1 to the previous record in seconds,
+ *                       humidity, temperature
+ *
+ * A record with delta 0 ends the block, so a zeroed block is empty. A gap
+ * longer than DHT11_MAX_DELTA seconds starts a new block. Blocks are only
+ * written whole, when they are full or at the sync interval, and synced
+ * at that interval, so the card sees a few page writes per hour instead
+ * of one per reading.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#define DHT11_STORE_DIR       "/var/lib/dht11"
+#define DHT11_BLOCK_MAGIC     0x42544844u     /* "DHTB" */
+#define DHT11_BLOCK_SIZE      4096
+#define DHT11_BLOCK_RECORDS   ((DHT11_BLOCK_SIZE - 8) / 4)
+#define DHT11_SEGMENT_BLOCKS  256             /* 1 MiB, about 6 days at 2 s */
+#define DHT11_SEGMENT_SIZE    (DHT11_BLOCK_SIZE * DHT11_SEGMENT_BLOCKS)
+#define DHT11_MAX_DELTA       65534
+#define DHT11_SYNC_INTERVAL   600             /* seconds of readings */
+
+struct dht11_record {
+  uint16_t delta;         /* seconds since the previous record + 1, 0 = end */
+  uint8_t  humidity;
+  uint8_t  temperature;
+};
+
+struct dht11_block {
+  uint32_t magic;
+  uint32_t first_time;
+  struct dht11_record record[DHT11_BLOCK_RECORDS];
+};
+
+/* writer state, one per directory */
+struct dht11_store {
+  char dir[256];
+  int fd;                 /* current segment, -1 before the first reading */
+  uint32_t block;         /* index of the current block in the segment */
+  uint32_t records;       /* records in the current block */
+  uint32_t last_time;
+  uint32_t synced_time;   /* time of the last record on the card */
+  uint32_t sync_interval;
+  int dirty;              /* current block changed since it was written */
+  struct dht11_block current;
+};
+
+/*
+ * Open the directory for appending, creating it when needed, and continue
+ * after the last record already stored. Returns 0, or -1 with errno set.
+ */
+int dht11_store_open(struct dht11_store *store, const char *dir, uint32_t sync_interval);
+/* append a reading, time in seconds since the epoch */
+int dht11_store_append(struct dht11_store *store, uint32_t time, uint8_t humidity,
+                       uint8_t temperature);
+/* write the current block and fdatasync() it */
+int dht11_store_sync(struct dht11_store *store);
+void dht11_store_close(struct dht11_store *store);
+
+struct dht11_stats {
+  uint64_t count;
+  uint32_t first_time;
+  uint32_t last_time;
+  uint8_t  min_humidity;
+  uint8_t  max_humidity;
+  uint8_t  min_temperature;
+  uint8_t  max_temperature;
+  uint64_t sum_humidity;
+  uint64_t sum_temperature;
+};
+
+/*
+ * Statistics of the readings in [from, to), read through mmap() of the
+ * segments. Several windows can be asked at once: stats[i] covers
+ * [from + i * step, from + (i + 1) * step), windows = 1 with step = to -
+ * from for a single one. Returns 0, or -1 with errno set.
+ */
+int dht11_store_query(const char *dir, uint32_t from, uint32_t step, size_t windows,
+                      struct dht11_stats *stats);
+
+#endif //DHT11_STORE_H_
@@ -0,0 +1,229 @@
+// Host benchmark of the DHT11 reading store, no Pi needed.
+//
+// gcc -O2 -o dht11_store_bench dht11_store_bench.c dht11_store.c -lm -std=gnu99
+// ./dht11_store_bench [-d dir] [-y days] [-p period] [-i sync interval] [-k]
+//
+// Stores -y days (365 by default) of synthetic readings, one every -p
+// seconds (2) with a few failed reads left out, with the same sync
+// policy as dht11_back, and prints the ingest rate and the size on disk.
+// Then it checks one query per day against sums kept while ingesting and
+// prints the latency of random windows of an hour up to the whole span.
+// The store goes to a new directory in /tmp unless -d is given and is
+// removed at the end unless -k.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include "dht11_store.h"
+
+#define START_TIME  1735689600u     // 2025-01-01 00:00:00 UTC
+#define DAY         (24 * 3600u)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void) {
+  // xorshift32, deterministic across runs
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// a day and a year cycle with some noise, in the range of the sensor
+static void synthetic(uint32_t t, uint8_t *h, uint8_t *temp) {
+  const double day = 2 * M_PI * (t % DAY) / DAY;
+  const double year = 2 * M_PI * ((t - START_TIME) % (365 * DAY)) / (365.0 * DAY);
+  *temp = (uint8_t)(20 - 6 * cos(year) - 4 * cos(day) + rng() % 3);
+  *h = (uint8_t)(55 + 15 * cos(day) + 10 * sin(year) + rng() % 5);
+}
+
+static uint64_t disk_usage(const char *dir, int files_only, int *files) {
+  char path[512];
+  struct dirent *d;
+  struct stat st;
+  uint64_t bytes = 0;
+  DIR *dp = opendir(dir);
+  *files = 0;
+  if (dp == NULL) {
+    return 0;
+  }
+  while ((d = readdir(dp)) != NULL) {
+    snprintf(path, sizeof(path), "%s/%s", dir, d->d_name);
+    if (d->d_name[0] != '.' && stat(path, &st) == 0) {
+      bytes += files_only ? (uint64_t)st.st_size : (uint64_t)st.st_blocks * 512;
+      *files += 1;
+    }
+  }
+  closedir(dp);
+  return bytes;
+}
+
+static void remove_store(const char *dir) {
+  char path[512];
+  struct dirent *d;
+  DIR *dp = opendir(dir);
+  if (dp == NULL) {
+    return;
+  }
+  while ((d = readdir(dp)) != NULL) {
+    if (d->d_name[0] != '.') {
+      snprintf(path, sizeof(path), "%s/%s", dir, d->d_name);
+      unlink(path);
+    }
+  }
+  closedir(dp);
+  rmdir(dir);
+}
+
+// average latency of random windows of the given length
+static void bench_window(const char *dir, const char *name, uint32_t span, uint32_t length,
+                         int queries) {
+  struct dht11_stats stats;
+  uint64_t readings = 0;
+  double started, elapsed;
+
+  if (length > span) {
+    return;
+  }
+  started = now();
+  for (int i = 0; i < queries; i++) {
+    uint32_t from = START_TIME + (span > length ? rng() % (span - length) : 0);
+    if (dht11_store_query(dir, from, length, 1, &stats) != 0) {
+      perror("query");
+      return;
+    }
+    readings += stats.count;
+  }
+  elapsed = now() - started;
+  printf("%-10s %8d %12.1f %14.0f\n", name, queries, elapsed / queries * 1e6,
+         (double)readings / queries);
+}
+
+int main(int argc, char *argv[]) {
+  char tmpdir[] = "/tmp/dht11_store_XXXXXX";
+  const char *dir = NULL;
+  uint32_t days = 365;
+  uint32_t period = 2;
+  uint32_t interval = DHT11_SYNC_INTERVAL;
+  int keep = 0;
+  struct dht11_store store;
+  struct dht11_stats *ref, *got;
+  uint64_t records = 0;
+  uint64_t bytes, size;
+  uint32_t t, span, mismatches = 0;
+  double started, elapsed;
+  int opt, files;
+
+  while ((opt = getopt(argc, argv, "d:y:p:i:k")) != -1) {
+    switch (opt) {
+      case 'd':
+        dir = optarg;
+        break;
+      case 'y':
+        days = (uint32_t)strtoul(optarg, NULL, 10);
+        break;
+      case 'p':
+        period = (uint32_t)strtoul(optarg, NULL, 10);
+        break;
+      case 'i':
+        interval = (uint32_t)strtoul(optarg, NULL, 10);
+        break;
+      case 'k':
+        keep = 1;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-d dir] [-y days] [-p period] [-i sync interval] [-k]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if (days == 0 || period == 0) {
+    fprintf(stderr, "days and period must be positive\n");
+    return 1;
+  }
+  if (dir == NULL) {
+    dir = mkdtemp(tmpdir);
+    if (dir == NULL) {
+      perror("mkdtemp");
+      return 1;
+    }
+  }
+  span = days * DAY;
+  ref = calloc(days, sizeof(*ref));
+  got = calloc(days, sizeof(*got));
+  if (ref == NULL || got == NULL || dht11_store_open(&store, dir, interval) != 0) {
+    perror(dir);
+    return 1;
+  }
+
+  // ingest, keeping per day sums to check the queries with
+  started = now();
+  for (t = START_TIME; t < START_TIME + span; t += period) {
+    struct dht11_stats *r = &ref[(t - START_TIME) / DAY];
+    uint8_t h, temp;
+    // about one read in a hundred fails and leaves a gap
+    if (rng() % 100 == 0) {
+      continue;
+    }
+    synthetic(t, &h, &temp);
+    if (dht11_store_append(&store, t, h, temp) != 0) {
+      perror("append");
+      return 1;
+    }
+    records++;
+    r->count++;
+    r->sum_humidity += h;
+    r->sum_temperature += temp;
+  }
+  dht11_store_close(&store);
+  elapsed = now() - started;
+  bytes = disk_usage(dir, 0, &files);
+  size = disk_usage(dir, 1, &files);
+  printf("ingest: %" PRIu64 " readings in %.2f s, %.0f readings/s, sync every %u s\n",
+         records, elapsed, records / elapsed, interval);
+  printf("disk: %d segments, %.1f MiB allocated, %.2f bytes per reading\n",
+         files, size / 1048576.0, (double)bytes / records);
+
+  // one window per day, in a single query
+  started = now();
+  if (dht11_store_query(dir, START_TIME, DAY, days, got) != 0) {
+    perror("query");
+    return 1;
+  }
+  elapsed = now() - started;
+  for (uint32_t d = 0; d < days; d++) {
+    if (got[d].count != ref[d].count || got[d].sum_humidity != ref[d].sum_humidity ||
+        got[d].sum_temperature != ref[d].sum_temperature) {
+      mismatches++;
+    }
+  }
+  printf("check: %u daily windows in %.1f ms, %u mismatches\n\n", days, elapsed * 1e3, mismatches);
+
+  printf("%-10s %8s %12s %14s\n", "window", "queries", "latency us", "readings/query");
+  bench_window(dir, "hour", span, 3600, 1000);
+  bench_window(dir, "day", span, DAY, 1000);
+  bench_window(dir, "week", span, 7 * DAY, 200);
+  bench_window(dir, "month", span, 30 * DAY, 50);
+  bench_window(dir, "all", span, span, 10);
+
+  if (!keep) {
+    remove_store(dir);
+  }
+  free(ref);
+  free(got);
+  return mismatches != 0;
+}
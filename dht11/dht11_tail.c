@@ -0,0 +1,78 @@
+// Print the readings published by dht11_back, without touching the sensor.
+//
+// gcc -o dht11_tail dht11_tail.c dht11_ring.c -lrt -std=gnu99
+// ./dht11_tail [-n count] [-f]
+//
+// Shows the last -n samples of the shared ring (10 by default), with -f
+// it keeps following new ones. One line per sample:
+//   <time> humidity <h> temperature <t> retries <r> decode <us> us
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "dht11_ring.h"
+
+#define FOLLOW_PERIOD_MS 200
+
+static void print_sample(const struct dht11_sample *s) {
+  time_t sec = (time_t)(s->time_us / 1000000);
+  struct tm tm = *localtime(&sec);
+  char when[32];
+  strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+  printf("%s humidity %u temperature %u retries %u decode %" PRIu32 " us\n",
+         when, s->humidity, s->temperature, s->retries, s->decode_us);
+}
+
+int main(int argc, char *argv[]) {
+  const struct dht11_ring *ring;
+  struct dht11_sample sample;
+  uint32_t count = 10;
+  uint32_t cursor, head;
+  uint32_t lost = 0;
+  int follow = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:f")) != -1) {
+    switch (opt) {
+      case 'n':
+        count = (uint32_t)atoi(optarg);
+        break;
+      case 'f':
+        follow = 1;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n count] [-f]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  ring = dht11_ring_open(DHT11_RING_NAME);
+  if (ring == NULL) {
+    perror("dht11 ring");
+    return 1;
+  }
+
+  head = dht11_ring_head(ring);
+  cursor = head - (count < head ? count : head);
+  for (;;) {
+    while (dht11_ring_next(ring, &cursor, &sample, &lost)) {
+      print_sample(&sample);
+    }
+    if (!follow) {
+      break;
+    }
+    fflush(stdout);
+    // only this sleep is a system call, reading the ring is not
+    usleep(FOLLOW_PERIOD_MS * 1000);
+  }
+  if (lost > 0) {
+    fprintf(stderr, "%" PRIu32 " samples overwritten before they were read\n", lost);
+  }
+
+  dht11_ring_close(ring);
+  return 0;
+}
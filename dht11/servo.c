@@ -8,12 +8,23 @@
 // sudo make install
 
 // gcc -o servo servo.c -l bcm2835 
-// sudo ./servo
+// sudo ./servo <temperature>
+//
+// daemon mode: set up the PWM once and take a temperature per line from
+// a FIFO, each update is then a single register write. The FIFO is
+// only open to root, and anything else found at its path is refused
+// sudo ./servo -d [fifo]
+// echo 23 | sudo tee /run/servo.fifo
 
 #include <bcm2835.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #define PIN RPI_GPIO_P1_12
 #define PWM_CHANNEL 0
@@ -28,6 +39,8 @@
 #define MIN_TEMP 0
 #define MAX_TEMP 50
 
+#define SERVO_FIFO "/run/servo.fifo"
+
 void writeMiliseconds(float value){
     if (value < MIN_PULSE_WIDTH) {
         value = MIN_PULSE_WIDTH;
@@ -59,8 +72,68 @@ void testServo(){
     }
 }
 
+// read temperatures from the FIFO until it fails, PWM is already set up
+int runDaemon(const char *path){
+    char line[32];
+    struct stat st;
+    FILE *fifo;
+    int fd;
+
+    if (mkfifo(path, 0600) < 0 && errno != EEXIST) {
+        perror(path);
+        return 1;
+    }
+    // an existing path may be a file or a link planted there
+    if (lstat(path, &st) < 0) {
+        perror(path);
+        return 1;
+    }
+    if (!S_ISFIFO(st.st_mode)) {
+        fprintf(stderr, "%s: not a FIFO\n", path);
+        return 1;
+    }
+    // opened read-write so we don't see EOF each time a writer closes it
+    fd = open(path, O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    // and it may have been swapped since the lstat()
+    if (fstat(fd, &st) < 0 || !S_ISFIFO(st.st_mode)) {
+        fprintf(stderr, "%s: not a FIFO\n", path);
+        close(fd);
+        return 1;
+    }
+    // created by an earlier run with a wider mode, or by someone else
+    if (fchmod(fd, 0600) < 0) {
+        perror(path);
+        close(fd);
+        return 1;
+    }
+    fifo = fdopen(fd, "r");
+    if (fifo == NULL) {
+        perror(path);
+        close(fd);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), fifo) != NULL) {
+        writeTemp(atof(line));
+    }
+    fclose(fifo);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
+    int daemon_mode = (argc > 1 && strcmp(argv[1], "-d") == 0);
+    int ret = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <temperature> | -d [fifo]\n", argv[0]);
+        return 1;
+    }
+
     if (!bcm2835_init()){
         return 1;
     }
@@ -77,9 +150,14 @@ int main(int argc, char **argv)
    // testServo();
    // writeMiliseconds(1);
 
-    writeTemp(atof(argv[1]));
+    if (daemon_mode) {
+        ret = runDaemon(argc > 2 ? argv[2] : SERVO_FIFO);
+    }
+    else {
+        writeTemp(atof(argv[1]));
+        delay(1000);
+    }
 
-    delay(1000);
     bcm2835_close();
-    return 0;
+    return ret;
 }
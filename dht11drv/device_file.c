@@ -0,0 +1,272 @@
+#include "device_file.h"
+#include "rpidht11_core.h"
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/delay.h>
+
+#include <linux/types.h>
+#include <linux/string.h>
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/kernel.h>
+#include <linux/gpio.h>
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/jiffies.h>
+#include <linux/mutex.h>
+#include <asm/uaccess.h>
+
+/**
+ * DHT11 data pin (BCM numbering, wiringPi pin 7)
+ */
+static int gpio = 4;
+module_param(gpio, int, S_IRUGO);
+MODULE_PARM_DESC(gpio, "GPIO connected to the DHT11 data line");
+
+/**
+ * Device driver name and its corresponding class name.
+ */
+#define DEVICE_NAME     "rpidht11"
+#define CLASS_NAME      "rpidht11_class"
+
+/**
+ * Start pulse and time given to the sensor, the frame itself is decoded
+ * in rpidht11_core.c
+ */
+#define START_PULSE_MS      18
+#define TRANSMISSION_US     6000
+#define MIN_INTERVAL_MS     1000    /* sensor can't be sampled faster */
+#define MAX_EDGES           96      /* FRAME_EDGES expected */
+
+/**
+ * Global variable for the first device number
+ */
+static dev_t  gst_dev;
+/**
+ * Global variable for the device class
+ */
+static struct class* gpst_rpidht11_class = (struct class *)NULL;
+/**
+ * Global variable for the character device structure
+ */
+static struct cdev c_dev;
+
+/**
+ * Operations provided by this device driver
+ */
+int rpidht11_open(struct inode *inode, struct file *filp);
+int rpidht11_release(struct inode *inode, struct file *filp);
+ssize_t rpidht11_read(struct file *filp, char __user *buff, size_t count, loff_t *offp);
+
+static struct file_operations rpidht11_fops = {
+  .owner      = THIS_MODULE,
+  .read       = rpidht11_read,
+  .open       = rpidht11_open,
+  .release    = rpidht11_release,
+};
+
+/**
+ * Edge timestamps recorded by the interrupt handler
+ */
+static u64 au64_edges[MAX_EDGES];
+static unsigned int ui32_edges = 0;
+/**
+ * Edge interrupt, requested once and only enabled during a measurement
+ */
+static int i32_irq = -1;
+
+/**
+ * Last valid reading, served again when asked within MIN_INTERVAL_MS
+ */
+static int i32_humidity = 0;
+static int i32_temperature = 0;
+static unsigned long ul_last_read = 0;
+static bool b_valid = false;
+static DEFINE_MUTEX(read_lock);
+
+/*===============================================================================================*/
+/*
+ * record the time of every edge on the data line
+ */
+static irqreturn_t rpidht11_edge_irq(int irq, void *dev_id) {
+  if(ui32_edges < MAX_EDGES) {
+    au64_edges[ui32_edges++] = ktime_get_ns();
+  }
+  return IRQ_HANDLED;
+}
+
+/*===============================================================================================*/
+/*
+ * send the start pulse and let the interrupt handler record the answer.
+ * The interrupt is on before the line is released: the sensor answers
+ * 20-40 us later, too soon to request it then.
+ */
+int rpidht11_measure(void) {
+  u8 aui8_data[DATA_BITS / 8];
+  u64 ui64_release = 0;
+  int i32_ret = 0;
+
+  /* start pulse, at least 18 ms low */
+  gpio_direction_output(gpio, 0);
+  msleep(START_PULSE_MS);
+
+  ui32_edges = 0;
+  enable_irq(i32_irq);
+  ui64_release = ktime_get_ns();
+  gpio_direction_input(gpio);
+  /* sleep, not spin, while the sensor is talking */
+  usleep_range(TRANSMISSION_US, TRANSMISSION_US + 1000);
+  disable_irq(i32_irq);
+
+  i32_ret = rpidht11_decode(au64_edges, ui32_edges, ui64_release, aui8_data);
+  if(i32_ret != 0) {
+    printk(KERN_DEBUG "[RPIDHT11] invalid data (%d edges): %d\n", ui32_edges, i32_ret);
+    return i32_ret;
+  }
+
+  i32_humidity = aui8_data[0];
+  i32_temperature = aui8_data[2];
+  ul_last_read = jiffies;
+  b_valid = true;
+  return 0;
+}
+
+/*===============================================================================================*/
+/*
+ * Open method
+ */
+int rpidht11_open(struct inode *inode, struct file *filp) {
+  return 0;
+}
+
+/*===============================================================================================*/
+/*
+ * Release method
+ */
+int rpidht11_release(struct inode *inode, struct file *filp) {
+  return 0;
+}
+
+/*===============================================================================================*/
+/*
+ * Read method, returns "<humidity> <temperature>\n". Reading again from
+ * offset 0 (e.g. pread) takes a new measurement.
+ */
+ssize_t rpidht11_read(struct file *filp, char __user *buff, size_t count, loff_t *offp) {
+  char sz_value[16];
+  int i32_len = 0;
+  int i32_ret = 0;
+
+  if(*offp > 0) {
+    return 0;
+  }
+
+  if(mutex_lock_interruptible(&read_lock)) {
+    return -ERESTARTSYS;
+  }
+  if(!b_valid || time_after(jiffies, ul_last_read + msecs_to_jiffies(MIN_INTERVAL_MS))) {
+    i32_ret = rpidht11_measure();
+  }
+  i32_len = snprintf(sz_value, sizeof(sz_value), "%d %d\n", i32_humidity, i32_temperature);
+  mutex_unlock(&read_lock);
+
+  if(i32_ret != 0) {
+    return i32_ret;
+  }
+  if(i32_len > count) {
+    return -EINVAL;
+  }
+  if(copy_to_user(buff, sz_value, i32_len)) {
+    return -EFAULT;
+  }
+  *offp += i32_len;
+  return i32_len;
+}
+
+/*===============================================================================================*/
+/*
+ * Initialize the driver.
+ */
+int __init rpidht11_register_device(void) {
+  int result = 0;
+
+  printk(KERN_NOTICE "[RPIDHT11] init_rpidht11 is called." );
+
+  result = gpio_request_one(gpio, GPIOF_IN, "DHT11");
+  if(result != 0) {
+    printk(KERN_WARNING "[RPIDHT11] Error request gpio %d\n", gpio);
+    return result;
+  }
+
+  i32_irq = gpio_to_irq(gpio);
+  if(i32_irq < 0) {
+    printk(KERN_WARNING "[RPIDHT11] No irq for gpio %d\n", gpio);
+    gpio_free(gpio);
+    return i32_irq;
+  }
+  result = request_irq(i32_irq, rpidht11_edge_irq,
+                       IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING, DEVICE_NAME, NULL);
+  if(result != 0) {
+    printk(KERN_WARNING "[RPIDHT11] Error request irq %d\n", i32_irq);
+    gpio_free(gpio);
+    return result;
+  }
+  /* IRQF_NO_AUTOEN is not in 4.4, off until a measurement */
+  disable_irq(i32_irq);
+
+  result = alloc_chrdev_region(&gst_dev, 0, 1, DEVICE_NAME);
+  if (0 > result) {
+    printk(KERN_ALERT "[RPIDHT11] device registration failed\n" );
+    free_irq(i32_irq, NULL);
+    gpio_free(gpio);
+    return result;
+  }
+
+  if ((gpst_rpidht11_class = class_create(THIS_MODULE, CLASS_NAME) ) == NULL) {
+    printk(KERN_ALERT "[RPIDHT11] class creation failed\n" );
+    unregister_chrdev_region(gst_dev, 1);
+    free_irq(i32_irq, NULL);
+    gpio_free(gpio);
+    return -1;
+  }
+
+  if (device_create(gpst_rpidht11_class, NULL, gst_dev, NULL, DEVICE_NAME) == NULL) {
+    printk(KERN_ALERT "[RPIDHT11] device creation failed\n" );
+    class_destroy(gpst_rpidht11_class);
+    unregister_chrdev_region(gst_dev, 1 );
+    free_irq(i32_irq, NULL);
+    gpio_free(gpio);
+    return -1;
+  }
+
+  cdev_init(&c_dev, &rpidht11_fops);
+
+  if (cdev_add(&c_dev, gst_dev, 1 ) == -1) {
+    printk(KERN_ALERT "[RPIDHT11] device addition failed\n" );
+    device_destroy(gpst_rpidht11_class, gst_dev);
+    class_destroy(gpst_rpidht11_class);
+    unregister_chrdev_region(gst_dev, 1 );
+    free_irq(i32_irq, NULL);
+    gpio_free(gpio);
+    return -1;
+  }
+
+  printk(KERN_ALERT "[RPIDHT11] LOADED\n");
+
+  return 0;
+}
+
+/*===============================================================================================*/
+/*
+ * Cleanup and unregister the driver.
+ */
+void __exit rpidht11_unregister_device(void) {
+    cdev_del(&c_dev);
+    device_destroy(gpst_rpidht11_class, gst_dev);
+    class_destroy(gpst_rpidht11_class);
+    unregister_chrdev_region(gst_dev, 1);
+    free_irq(i32_irq, NULL);
+    gpio_free(gpio);
+}
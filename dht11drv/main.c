@@ -0,0 +1,25 @@
+#include "device_file.h"
+#include <linux/init.h>       /* module_init, module_exit */
+#include <linux/module.h> /* version info, MODULE_LICENSE, MODULE_AUTHOR, printk() */
+
+/*===============================================================================================*/
+static int rpidht11_driver_init(void) {
+  int result = 0;
+  printk(KERN_NOTICE "[RPIDHT11]: Initialization started");
+
+  result = rpidht11_register_device();
+  return result;
+}
+
+static void rpidht11_driver_exit(void) {
+  printk(KERN_NOTICE "[RPIDHT11]: Exiting");
+  rpidht11_unregister_device();
+}
+
+/*===============================================================================================*/
+module_init(rpidht11_driver_init);
+module_exit(rpidht11_driver_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Maciej Zakrzewski");
+MODULE_DESCRIPTION("DHT11 humidity and temperature sensor driver for raspberry PI");
@@ -0,0 +1,60 @@
+#include "rpidht11_core.h"
+
+/*
+ * Decoding of the edge timestamps, shared by the kernel module and the
+ * host simulator in sim/. Nothing in here touches the hardware.
+ */
+
+/*===============================================================================================*/
+/*
+ * decode the 40 bits from the edge timestamps recorded after the host
+ * released the line at ui64_release (ns). Edges within RELEASE_GUARD_NS
+ * of it are the release itself, or an edge of the start pulse replayed
+ * when the interrupt was enabled, the sensor answers 20 us later at the
+ * earliest. What remains must be FRAME_EDGES edges, or one less when the
+ * rising edge after bit 40 was missed: edge 0 falls at the start of the
+ * response, then bit n (from 0) rises at 3 + 2n and falls at 4 + 2n. Any other
+ * count means an edge was lost or added and the pairs can't be trusted,
+ * and so can't a frame whose lows are not about 50 us.
+ */
+int rpidht11_decode(const uint64_t *pui64_edges, unsigned int ui32_edges,
+                    const uint64_t ui64_release, uint8_t *pui8_data) {
+  unsigned int ui32_first = 0;
+  int i32_bit = 0;
+
+  while(ui32_first < ui32_edges && pui64_edges[ui32_first] < ui64_release + RELEASE_GUARD_NS) {
+    ui32_first++;
+  }
+  pui64_edges += ui32_first;
+  ui32_edges -= ui32_first;
+  if(ui32_edges < FRAME_EDGES - 1) {
+    return -ETIMEDOUT;
+  }
+  if(ui32_edges > FRAME_EDGES) {
+    return -EIO;
+  }
+
+  for(i32_bit = 0; i32_bit < DATA_BITS / 8; i32_bit++) {
+    pui8_data[i32_bit] = 0;
+  }
+  for(i32_bit = 0; i32_bit < DATA_BITS; i32_bit++) {
+    const uint64_t ui64_low = pui64_edges[3 + 2 * i32_bit] - pui64_edges[2 + 2 * i32_bit];
+    const uint64_t ui64_high = pui64_edges[4 + 2 * i32_bit] - pui64_edges[3 + 2 * i32_bit];
+    if(ui64_low < LOW_MIN_NS || ui64_low > LOW_MAX_NS || ui64_high > HIGH_MAX_NS) {
+      return -EIO;
+    }
+    pui8_data[i32_bit / 8] <<= 1;
+    if(ui64_high > BIT_THRESHOLD_NS) {
+      pui8_data[i32_bit / 8] |= 1;
+    }
+  }
+
+  if(pui8_data[4] != ((pui8_data[0] + pui8_data[1] + pui8_data[2] + pui8_data[3]) & 0xFF)) {
+    return -EIO;
+  }
+  /* the sensor reports 20 %RH at least, a zero frame is never a reading */
+  if(pui8_data[0] == 0) {
+    return -EIO;
+  }
+  return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef RPIDHT11_CORE_H_
+#define RPIDHT11_CORE_H_
+/*
+ * Hardware independent part of the rpidht11 driver, see rpidht11_core.c
+ */
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/errno.h>
+#else
+#include <stdint.h>
+#include <errno.h>
+#endif
+
+/**
+ * Sensor timings. A transmission is a 80 us low + 80 us high response,
+ * then 40 bits of 50 us low followed by 26-28 us (0) or 70 us (1) high,
+ * then 50 us low before the line is released. The response starts 20-40 us
+ * after the host releases the line.
+ */
+#define DATA_BITS           40
+#define FRAME_EDGES         84      /* response 3, data 80, release 1 */
+#define BIT_THRESHOLD_NS    50000   /* between a 0 and a 1 high pulse */
+#define LOW_MIN_NS          35000   /* low before every bit, nominally 50 us */
+#define LOW_MAX_NS          65000
+#define HIGH_MAX_NS         90000
+#define RELEASE_GUARD_NS    15000   /* edges this close to the release are the host's */
+
+int rpidht11_decode(const uint64_t *pui64_edges, unsigned int ui32_edges,
+                    const uint64_t ui64_release, uint8_t *pui8_data);
+
+#endif //RPIDHT11_CORE_H_
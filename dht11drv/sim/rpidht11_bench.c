@@ -0,0 +1,258 @@
+// Host simulation of the failure rate of the rpidht11 interrupt reader
+// against the wiringPi polling reader of dht11_back, no Pi needed.
+//
+// make -C dht11drv bench && dht11drv/rpidht11_bench [-n reads] [-s seed]
+//
+// Every read is a random DHT11 frame with the datasheet timings and a few
+// microseconds of jitter per level. The same frame goes to both readers:
+//   polling  dht11_read_val: a loop of digitalRead() and delayMicroseconds(1),
+//            about LOOP_NS per iteration, counting iterations per level and
+//            decoded by dht11_decode() with DHT11_DECODE_COUNTER. Preempting
+//            the loop loses the edges that happen meanwhile
+//   irq      rpidht11_measure: one timestamp per edge taken after the IRQ
+//            latency. An edge arriving before the previous one was handled
+//            sets the same event bit of the BCM2835 and is lost. Decoded by
+//            rpidht11_decode() of the driver
+// A read is right, wrong (passed the checks with other values) or
+// rejected. The load levels are assumptions, not measurements of a Pi:
+//   idle     no preemption, IRQ latency 2-6 us
+//   loaded   the polling thread is preempted once for 0.1-2 ms in 30 % of
+//            the reads; 0.2 % of the edges meet an interrupts-off section
+//            of up to 30 us
+//   heavy    preempted in 80 % of the reads, 1 % of the edges delayed by up
+//            to 60 us
+// An edge handled more than 15 us late moves a low out of the 35-65 us the
+// driver accepts, so the interrupt reader is only as good as the longest
+// interrupts-off sections of the kernel.
+// The CPU column is the time spent per read: the spinning loop for polling,
+// IRQ_HANDLER_NS per edge for the interrupt reader. On a Pi the same
+// comparison is the [reader] line of the dht11_back report, with and without
+// the module loaded.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../rpidht11_core.h"
+#include "../../dht11/dht11_decode.h"
+
+#define EDGES           FRAME_EDGES
+#define LOOP_NS         3000        // dht11_read_val, DHT11_DECODE_COUNTER assumes 16 per 48 us
+#define MAX_TIME        85          // levels recorded by dht11_read_val
+#define IRQ_HANDLER_NS  2000
+#define MAX_RECORDED    96          // MAX_EDGES of the driver
+
+enum load { IDLE, LOADED, HEAVY, LOADS };
+static const char *load_names[LOADS] = { "idle", "loaded", "heavy" };
+
+struct load_model {
+  unsigned int preempt_pct;     // reads where the polling thread is scheduled out
+  int64_t preempt_min_ns;
+  int64_t preempt_max_ns;
+  unsigned int irqoff_permille; // edges meeting an interrupts-off section
+  int64_t irqoff_max_ns;
+};
+
+static const struct load_model models[LOADS] = {
+  { 0, 0, 0, 0, 0 },
+  { 30, 100000, 2000000, 2, 30000 },
+  { 80, 100000, 2000000, 10, 60000 },
+};
+
+enum outcome { RIGHT, WRONG, REJECTED, OUTCOMES };
+
+struct result {
+  unsigned long count[OUTCOMES];
+  int64_t cpu_ns;
+};
+
+// ---------------------------------------------------
+// SENSOR
+// ---------------------------------------------------
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void) {
+  // xorshift32, reproducible with -s
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+static int64_t uniform(int64_t lo, int64_t hi) {
+  return lo + (int64_t)(rng() % (uint32_t)(hi - lo + 1));
+}
+
+// edge times in ns after the host released the line: the response falls at
+// edges[0], bit n rises at 3 + 2n and falls at 4 + 2n, the line is released
+// at edges[83]
+static void make_frame(uint8_t *data, int64_t *edges) {
+  int64_t t;
+  int bit, i = 0;
+
+  data[0] = 20 + rng() % 70;
+  data[1] = 0;
+  data[2] = rng() % 50;
+  data[3] = 0;
+  data[4] = data[0] + data[1] + data[2] + data[3];
+
+  t = uniform(20000, 40000);
+  edges[i++] = t;
+  t += uniform(78000, 82000);
+  edges[i++] = t;
+  t += uniform(78000, 82000);
+  edges[i++] = t;
+  for (bit = 0; bit < DATA_BITS; bit++) {
+    const int one = (data[bit / 8] >> (7 - bit % 8)) & 1;
+    t += uniform(47000, 55000);
+    edges[i++] = t;
+    t += one ? uniform(67000, 74000) : uniform(24000, 30000);
+    edges[i++] = t;
+  }
+  t += uniform(47000, 55000);
+  edges[i++] = t;
+}
+
+// ---------------------------------------------------
+// READERS
+// ---------------------------------------------------
+
+// dht11_read_val: the line is high when sampling starts 40 us after the
+// release, each level is counted until it changes or 255 iterations pass
+static enum outcome read_polling(const uint8_t *data, const int64_t *edges,
+                                 const struct load_model *m, int64_t *cpu_ns) {
+  static const struct dht11_decode_cfg cfg = DHT11_DECODE_COUNTER;
+  uint32_t durations[MAX_TIME];
+  struct dht11_reading reading;
+  const int64_t start = 40000;
+  int64_t t = start;
+  int64_t preempt_at = -1, preempt_len = 0;
+  int next = 0;                 // first edge after t
+  int state = 1, level, i;
+
+  if (rng() % 100 < m->preempt_pct) {
+    preempt_at = uniform(start, edges[EDGES - 1]);
+    preempt_len = uniform(m->preempt_min_ns, m->preempt_max_ns);
+  }
+  for (i = 0; i < MAX_TIME; i++) {
+    uint32_t counter = 0;
+    for (;;) {
+      while (next < EDGES && edges[next] <= t) {
+        next++;
+      }
+      level = (next % 2 == 0);
+      if (level != state) {
+        break;
+      }
+      counter++;
+      t += uniform(LOOP_NS - 300, LOOP_NS + 300);
+      if (preempt_at >= 0 && t >= preempt_at) {
+        t += preempt_len;
+        *cpu_ns -= preempt_len;
+        preempt_at = -1;
+      }
+      if (counter == 255) {
+        break;
+      }
+    }
+    state = level;
+    if (counter == 255) {
+      break;
+    }
+    durations[i] = counter;
+  }
+  *cpu_ns += t - start;
+
+  if (dht11_decode(durations, i, &cfg, &reading) != DHT11_OK) {
+    return REJECTED;
+  }
+  return (reading.humidity == data[0] && reading.temperature == data[2]) ? RIGHT : WRONG;
+}
+
+static int64_t irq_latency(const struct load_model *m) {
+  int64_t ns = uniform(2000, 6000);
+  if (m->irqoff_permille != 0 && rng() % 1000 < m->irqoff_permille) {
+    ns += uniform(0, m->irqoff_max_ns);
+  }
+  return ns;
+}
+
+// rpidht11_measure: the release edge of the host comes first, then the
+// sensor's; the driver calls the release 0
+static enum outcome read_irq(const uint8_t *data, const int64_t *edges,
+                             const struct load_model *m, int64_t *cpu_ns) {
+  uint64_t recorded[MAX_RECORDED];
+  uint8_t decoded[DATA_BITS / 8];
+  unsigned int count = 0;
+  int64_t serviced = -1;
+  int i;
+
+  for (i = -1; i < EDGES; i++) {
+    const int64_t edge = (i < 0) ? 1000 : edges[i];
+    if (edge < serviced) {
+      continue;             // event bit still set, this edge is lost
+    }
+    serviced = edge + irq_latency(m);
+    if (count < MAX_RECORDED) {
+      recorded[count++] = (uint64_t)serviced;
+    }
+    *cpu_ns += IRQ_HANDLER_NS;
+  }
+
+  if (rpidht11_decode(recorded, count, 0, decoded) != 0) {
+    return REJECTED;
+  }
+  return (decoded[0] == data[0] && decoded[2] == data[2]) ? RIGHT : WRONG;
+}
+
+// ---------------------------------------------------
+// MAIN
+// ---------------------------------------------------
+int main(int argc, char *argv[]) {
+  unsigned long reads = 100000;
+  int opt, l;
+
+  while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+    switch (opt) {
+      case 'n':
+        reads = strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        rng_state = strtoul(optarg, NULL, 10) | 1;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n reads] [-s seed]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (reads == 0) {
+    fprintf(stderr, "reads must be positive\n");
+    return 1;
+  }
+
+  printf("%-7s %-8s %8s %9s %9s %9s %10s\n", "load", "reader", "reads", "right %", "wrong %",
+         "reject %", "cpu us/rd");
+  for (l = 0; l < LOADS; l++) {
+    struct result polling, irq;
+    unsigned long n;
+
+    memset(&polling, 0, sizeof(polling));
+    memset(&irq, 0, sizeof(irq));
+    for (n = 0; n < reads; n++) {
+      uint8_t data[DATA_BITS / 8];
+      int64_t edges[EDGES];
+      make_frame(data, edges);
+      polling.count[read_polling(data, edges, &models[l], &polling.cpu_ns)]++;
+      irq.count[read_irq(data, edges, &models[l], &irq.cpu_ns)]++;
+    }
+    printf("%-7s %-8s %8lu %9.3f %9.3f %9.3f %10.1f\n", load_names[l], "polling", reads,
+           100.0 * polling.count[RIGHT] / reads, 100.0 * polling.count[WRONG] / reads,
+           100.0 * polling.count[REJECTED] / reads, polling.cpu_ns / 1000.0 / reads);
+    printf("%-7s %-8s %8lu %9.3f %9.3f %9.3f %10.1f\n", load_names[l], "irq", reads,
+           100.0 * irq.count[RIGHT] / reads, 100.0 * irq.count[WRONG] / reads,
+           100.0 * irq.count[REJECTED] / reads, irq.cpu_ns / 1000.0 / reads);
+  }
+  return 0;
+}
@@ -1,4 +1,7 @@
 #include "device_file.h"
+#include "rpilcd_ioctl.h"
+#include "rpilcd_core.h"
+#include "rpilcd_pcf8574.h"
 
 #include <linux/module.h>
 #include <linux/slab.h>
@@ -15,11 +18,33 @@
 #include <linux/cdev.h>
 #include <linux/kernel.h>
 #include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/atomic.h>
+#include <linux/mutex.h>
+#include <linux/completion.h>
+#include <linux/poll.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/idr.h>
+#include <linux/of.h>
+#include <linux/platform_device.h>
+#include <linux/i2c.h>
+#include <linux/property.h>
 #include <asm/uaccess.h>
 
+#define CREATE_TRACE_POINTS
+#include "rpilcd_trace.h"
+
 /**
- * LCD PIN NUMBERS CONNECTED to RaspberryPi
+ * LCD PIN NUMBERS CONNECTED to RaspberryPi, defaults of the first panel
  */
 #define LCD_RS          26
 #define LCD_EN          19
@@ -27,6 +52,87 @@
 #define LCD_D5          6
 #define LCD_D6          5
 #define LCD_D7          11
+#define LCD_RW          20      /* only used with busyflag=1 */
+
+/**
+ * Panels can come from Device Tree, e.g.
+ *
+ *   lcd@0 {
+ *     compatible = "rpi,rpilcd";
+ *     rs-gpios = <&gpio 26 0>;
+ *     enable-gpios = <&gpio 19 0>;
+ *     data-gpios = <&gpio 13 0>, <&gpio 6 0>, <&gpio 5 0>, <&gpio 11 0>;
+ *                                          (D4..D7, or D0..D7 for 8 bits)
+ *     rw-gpios = <&gpio 20 0>;                (optional)
+ *     display-height-chars = <4>;
+ *     display-width-chars = <20>;
+ *   };
+ *
+ * or from the module parameters below, one array entry per panel. Each
+ * panel becomes /dev/rpilcdN with its own worker.
+ */
+#define RPILCD_MAX_DEVICES  4
+
+static int panels = 1;
+module_param(panels, int, S_IRUGO);
+MODULE_PARM_DESC(panels, "Number of panels described by module parameters, 0 with Device Tree");
+
+static int rs[RPILCD_MAX_DEVICES] = { LCD_RS, -1, -1, -1 };
+module_param_array(rs, int, NULL, S_IRUGO);
+MODULE_PARM_DESC(rs, "RS GPIO of each panel");
+
+static int en[RPILCD_MAX_DEVICES] = { LCD_EN, -1, -1, -1 };
+module_param_array(en, int, NULL, S_IRUGO);
+MODULE_PARM_DESC(en, "EN GPIO of each panel");
+
+static int rw[RPILCD_MAX_DEVICES] = { LCD_RW, -1, -1, -1 };
+module_param_array(rw, int, NULL, S_IRUGO);
+MODULE_PARM_DESC(rw, "R/W GPIO of each panel, -1 when tied low");
+
+static int buswidth[RPILCD_MAX_DEVICES] = { 4, 4, 4, 4 };
+module_param_array(buswidth, int, NULL, S_IRUGO);
+MODULE_PARM_DESC(buswidth, "Data bus of each panel, 4 (D4-D7) or 8 (D0-D7) lines");
+
+static int data[RPILCD_MAX_DEVICES * 8] = { LCD_D4, LCD_D5, LCD_D6, LCD_D7 };
+module_param_array(data, int, NULL, S_IRUGO);
+MODULE_PARM_DESC(data, "D4..D7 or D0..D7 GPIOs, buswidth entries per panel in a row");
+
+static int rows[RPILCD_MAX_DEVICES] = { 2, 2, 2, 2 };
+module_param_array(rows, int, NULL, S_IRUGO);
+MODULE_PARM_DESC(rows, "Lines of each panel (1-4)");
+
+static int cols[RPILCD_MAX_DEVICES] = { 16, 16, 16, 16 };
+module_param_array(cols, int, NULL, S_IRUGO);
+MODULE_PARM_DESC(cols, "Characters per line of each panel (up to 20)");
+
+/**
+ * Busy flag mode: read DB7 after every byte instead of waiting the worst
+ * case execution time. Needs the R/W line wired, panels without it keep
+ * the fixed delays, and so do panels whose address counter does not read
+ * back at init, see rpilcd_check_rw().
+ */
+static bool busyflag = false;
+module_param(busyflag, bool, S_IRUGO);
+MODULE_PARM_DESC(busyflag, "Poll the HD44780 busy flag on panels with a R/W line");
+
+#define BUSY_TIMEOUT_US     2000  /* longest command (clear) takes 1.52 ms */
+#define BUSY_MAX_TIMEOUTS   8     /* consecutive timeouts before giving up */
+#define BUSY_POLL_US        10    /* sleep between two reads of the busy flag */
+
+/* worst case execution time of a byte, the fixed delays */
+#define EXEC_DATA_US        200
+#define EXEC_CMD_US         4500
+
+/**
+ * Send the bytes of a flush from an hrtimer and sleep while the controller
+ * executes them, instead of spinning in udelay(). Can be changed at run
+ * time to compare both. Panels on GPIOs which may sleep always use the
+ * direct path, and so do panels polling the busy flag: turning the data
+ * lines around may sleep.
+ */
+static bool txtimer = true;
+module_param(txtimer, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(txtimer, "Drive the bus from an hrtimer instead of delays in the worker");
 
 /**
  * Device driver name and its corresponding class name.
@@ -43,9 +149,20 @@ static dev_t  gst_dev;
  */
 static struct class* gpst_rpilcd_class = (struct class *)NULL;
 /**
- * Global variable for the character device structure
+ * Minor numbers in use, and the bound panel of each: open() takes its
+ * reference under gst_rpilcd_lock
+ */
+static DEFINE_IDA(rpilcd_ida);
+static struct rpilcd_dev_t* apst_rpilcd[RPILCD_MAX_DEVICES];
+static DEFINE_MUTEX(gst_rpilcd_lock);
+/**
+ * debugfs directory holding one directory of counters per panel
+ */
+static struct dentry* gpst_rpilcd_debugfs = (struct dentry *)NULL;
+/**
+ * Platform devices created from the module parameters
  */
-static struct cdev c_dev;
+static struct platform_device* apst_pdev[RPILCD_MAX_DEVICES];
 
 /**
  * Operations provided by this device driver
@@ -54,69 +171,604 @@ int rpilcd_open(struct inode *inode, struct file *filp);
 int rpilcd_release(struct inode *inode, struct file *filp);
 ssize_t rpilcd_read(struct file *filp, char __user *buff, size_t count, loff_t *offp);
 ssize_t rpilcd_write(struct file *filp, const char __user *buff, size_t count, loff_t *offp);
+int rpilcd_fsync(struct file *filp, loff_t start, loff_t end, int datasync);
+long rpilcd_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
+int rpilcd_mmap(struct file *filp, struct vm_area_struct *vma);
+unsigned int rpilcd_poll(struct file *filp, poll_table *wait);
+loff_t rpilcd_llseek(struct file *filp, loff_t off, int whence);
 
 static struct file_operations rpilcd_fops = {
   .owner      = THIS_MODULE,
+  .llseek     = rpilcd_llseek,
   .read       = rpilcd_read,
   .write      = rpilcd_write,
+  .fsync      = rpilcd_fsync,
+  .unlocked_ioctl = rpilcd_ioctl,
+  .mmap       = rpilcd_mmap,
+  .poll       = rpilcd_poll,
   .open       = rpilcd_open,
   .release    = rpilcd_release,
 };
 
-/* representation of the device */
-static struct rpilcd_dev_t {
-  struct cdev st_cdev;            /* char device structure */
+/*
+ * Writes are put on a bounded queue and drawn by a worker, so write() does
+ * not wait for the bus. All requests queued while the worker was busy are
+ * applied before a single flush, so only the newest frame gets drawn.
+ * A write() is queued in chunks of WRITE_CHUNK bytes, the worker does not
+ * flush before its last one. reqHead/reqTail/reqDone are free running
+ * counters.
+ */
+#define QUEUE_LEN 16
+#define WRITE_CHUNK 256
+/* queue to glass latency, bucket i counts requests under 2^i ms */
+#define LATENCY_BUCKETS 12
+enum rpilcd_req_type {
+  REQ_WRITE,                      /* write() */
+  REQ_FRAME,                      /* RPILCD_IOC_SET_FRAME */
+  REQ_MAP,                        /* dirty cells of the mmap()ed buffer */
+  REQ_GLYPH,                      /* RPILCD_IOC_PUT_GLYPH */
+  REQ_BARS,                       /* RPILCD_IOC_BARS */
+  REQ_MARQUEE,                    /* RPILCD_IOC_MARQUEE */
+};
+struct rpilcd_req_t {
+  enum rpilcd_req_type type;
+  size_t count;                   /* bytes of data for REQ_WRITE */
+  bool more;                      /* REQ_WRITE: the write() goes on in the next request */
+  ktime_t queued;                 /* for the latency histogram */
+  union {
+    char data[WRITE_CHUNK];
+    struct rpilcd_frame frame;
+    struct rpilcd_glyph glyph;
+    struct rpilcd_bars bars;
+    struct rpilcd_marquee marquee;
+  };
 };
 
-/*
- * three defined values for the flags (asm-generic/gpio.h) :
- * GPIOF_IN                     => GPIO defined as input
- * GPIOF_OUT_INIT_LOW   => GPIO defined as output, initial level LOW
- * GPIOF_OUT_INIT_HIGH  => GPIO defined as output, initial level HIGH
+/* byte waiting to be sent by the hrtimer */
+#define TX_LEN 64
+struct rpilcd_tx_t {
+  unsigned char rs;
+  unsigned char byte;
+};
+
+/**
+ * How bytes reach the controller: GPIO lines driven by the CPU, or a
+ * PCF8574 I2C backpack which takes a whole flush in one message
+ */
+struct rpilcd_dev_t;
+struct rpilcd_transport_t {
+  const char *name;
+  /* latch the low 4 or 8 bits with RS at i32_rs_level, right away */
+  void (*put_nibble)(struct rpilcd_dev_t *, const unsigned char);
+  /* a byte and its execution time, may only be queued */
+  void (*write_byte)(struct rpilcd_dev_t *, const unsigned char);
+  /* send what write_byte queued, NULL when nothing is ever queued */
+  void (*flush)(struct rpilcd_dev_t *);
+};
+
+/* representation of the device, one per panel */
+struct rpilcd_dev_t {
+  struct cdev *pst_cdev;          /* char device structure */
+  int i32_minor;                  /* /dev/rpilcdN */
+  /**
+   * held by the bound device and by every open file, the last put frees
+   * the panel. Files may outlive an unbind: b_gone is set then, under
+   * writeLock, and nothing reaches the bus or the worker afterwards.
+   */
+  struct kref st_ref;
+  bool b_gone;
+
+  /**
+   * GPIO descriptors of the LCD lines, the data lines are set with one
+   * array write: D4..D7 on a 4 bit bus, D0..D7 on an 8 bit bus, which
+   * takes a byte in one strobe instead of two. The RS level is kept in
+   * software instead of being read back.
+   */
+  struct gpio_desc * pst_rs;
+  struct gpio_desc * pst_en;
+  struct gpio_desc * pst_rw;      /* NULL when R/W is tied low */
+  struct gpio_desc * apst_data[8];
+  int i32_width;                  /* data lines used, 4 or 8 */
+  int i32_rs_level;
+  bool b_busyflag;
+  unsigned int ui32_timeouts;
+
+  /**
+   * transport under rpilcd_write_byte(). An I2C panel has no GPIO
+   * descriptors, no busy flag and no hrtimer: its bytes are queued in pcf
+   * and sent by the flush of the transport.
+   */
+  const struct rpilcd_transport_t *pst_transport;
+  struct i2c_client *pst_client;  /* NULL on GPIO panels */
+  struct rpilcd_pcf8574_t pcf;
+
+  /**
+   * bytes of a flush sent by rpilcd_tx_timer(). The CPU only works for
+   * the few microseconds of each nibble, the execution time of a byte is
+   * left to the timer. The worker sleeps on txDone meanwhile.
+   */
+  bool b_timer;                   /* no line can sleep, the timer may drive them */
+  bool b_txActive;                /* the current flush goes through txBuf */
+  struct rpilcd_tx_t txBuf[TX_LEN];
+  unsigned int txHead;
+  unsigned int txTail;
+  struct hrtimer st_timer;
+  struct completion st_txDone;
+
+  /**
+   * text model of the display, see rpilcd_core.c. Only the worker uses
+   * it, writers never touch it and only hold reqLock to queue a request.
+   * busLock is held around the bit-banging alone, so nothing else waits
+   * behind a flush of several milliseconds.
+   */
+  struct rpilcd_core_t core;
+  struct mutex busLock;
+  /* page shared with userspace through mmap(), see struct rpilcd_map */
+  struct rpilcd_map *pst_map;
+
+  /* request queue and the worker drawing it */
+  struct rpilcd_req_t reqQueue[QUEUE_LEN];
+  unsigned int reqHead;           /* next request to apply */
+  unsigned int reqTail;           /* next free slot */
+  unsigned int reqDone;           /* requests applied and on the glass */
+  bool b_midWrite;                /* the worker got a chunk with more set */
+  spinlock_t reqLock;
+  wait_queue_head_t reqWait;
+  struct workqueue_struct *wq;
+  struct work_struct st_work;
+  /* keeps the chunks of one write() together on the queue */
+  struct mutex writeLock;
+  /* steps of the marquee, queued on wq too so they never run beside st_work */
+  struct delayed_work st_marquee;
+  /* applied by the worker and not flushed yet, with their queue times */
+  unsigned int pending;
+  ktime_t pendingQueued[QUEUE_LEN];
+  unsigned int pendingTimes;
+
+  /**
+   * text of the glass served by read(), published after every flush.
+   * Readers only take snapLock for a copy, never busLock. The snapSeq a
+   * file has read is kept in its f_version.
+   */
+  char snapshot[RPILCD_SNAPSHOT_MAX];
+  size_t snapLen;
+  unsigned int snapSeq;
+  spinlock_t snapLock;
+  wait_queue_head_t readWait;
+
+  /**
+   * performance counters, in debugfs under rpilcd/rpilcdN/. Only the
+   * worker updates them, except writes which is counted under reqLock.
+   */
+  struct dentry *pst_debugfs;
+  unsigned int writes;            /* requests queued */
+  unsigned int flushes;
+  unsigned int coalesced;         /* requests drawn by another one's flush */
+  unsigned int cmdNibbles;        /* strobes, two per byte on a 4 bit bus */
+  unsigned int dataNibbles;
+  u64 delayUs;                    /* time in udelay() and usleep_range() */
+  unsigned int timerCallbacks;
+  unsigned int latencyHist[LATENCY_BUCKETS];
+
+  /* contention stats, in sysfs */
+  unsigned int lockContended;     /* reqLock was held by another CPU */
+  unsigned int busContended;      /* busLock was held by another flush */
+  unsigned int queueWaits;        /* writers blocked on a full queue */
+};
+
+/**
+ * Wiring of a panel given by module parameters
  */
-static struct gpio rpilcd_gpios[] = {
-        { LCD_RS, GPIOF_OUT_INIT_LOW, "LCD_RS" },
-        { LCD_EN, GPIOF_OUT_INIT_LOW, "LCD_EN" },
-        { LCD_D4, GPIOF_OUT_INIT_LOW, "LCD_D4" },
-        { LCD_D5, GPIOF_OUT_INIT_LOW, "LCD_D5" },
-        { LCD_D6, GPIOF_OUT_INIT_LOW, "LCD_D6" },
-        { LCD_D7, GPIOF_OUT_INIT_LOW, "LCD_D7" },
+struct rpilcd_pins_t {
+  int rs;
+  int en;
+  int rw;
+  int width;                      /* 4 or 8 */
+  int data[8];                    /* D4..D7 or D0..D7 */
+  int rows;
+  int cols;
 };
 
-struct rpilcd_dev_t * pst_rpilcd = (struct rpilcd_dev_t *)NULL;
+/*===============================================================================================*/
+/*
+ * request one GPIO given by number as an output, low
+ */
+static struct gpio_desc *rpilcd_request_gpio(struct device *dev, const int i32_gpio,
+                                             const char *sz_label) {
+  int i32_ret = devm_gpio_request_one(dev, i32_gpio, GPIOF_OUT_INIT_LOW, sz_label);
+  if(i32_ret != 0) {
+    return ERR_PTR(i32_ret);
+  }
+  return gpio_to_desc(i32_gpio);
+}
 
 /*===============================================================================================*/
 /*
- * write a byte to lcd HD44780 controller
+ * get the LCD lines and the geometry from Device Tree or from the pins
+ * given by module parameters
+ */
+int rpilcd_lookup_gpios(struct rpilcd_dev_t * const pst_rpilcd, struct device *dev,
+                        int * const pi32_rows, int * const pi32_cols) {
+  static const char * const asz_data[8] = { "LCD_D0", "LCD_D1", "LCD_D2", "LCD_D3",
+                                            "LCD_D4", "LCD_D5", "LCD_D6", "LCD_D7" };
+  const struct rpilcd_pins_t *pst_pins = dev->platform_data;
+  u32 ui32_value = 0;
+  int i32_idx = 0;
+
+  if(dev->of_node != NULL) {
+    pst_rpilcd->pst_rs = devm_gpiod_get(dev, "rs", GPIOD_OUT_LOW);
+    pst_rpilcd->pst_en = devm_gpiod_get(dev, "enable", GPIOD_OUT_LOW);
+    /* the bus width follows the number of data lines */
+    pst_rpilcd->i32_width = (gpiod_count(dev, "data") == 8) ? 8 : 4;
+    for(i32_idx = 0; i32_idx < pst_rpilcd->i32_width; i32_idx++) {
+      pst_rpilcd->apst_data[i32_idx] = devm_gpiod_get_index(dev, "data", i32_idx, GPIOD_OUT_LOW);
+    }
+    if(busyflag) {
+      pst_rpilcd->pst_rw = devm_gpiod_get_optional(dev, "rw", GPIOD_OUT_LOW);
+    }
+    *pi32_rows = 2;
+    *pi32_cols = 16;
+    if(device_property_read_u32(dev, "display-height-chars", &ui32_value) == 0) {
+      *pi32_rows = ui32_value;
+    }
+    if(device_property_read_u32(dev, "display-width-chars", &ui32_value) == 0) {
+      *pi32_cols = ui32_value;
+    }
+  }
+  else if(pst_pins != NULL) {
+    pst_rpilcd->pst_rs = rpilcd_request_gpio(dev, pst_pins->rs, "LCD_RS");
+    pst_rpilcd->pst_en = rpilcd_request_gpio(dev, pst_pins->en, "LCD_EN");
+    pst_rpilcd->i32_width = pst_pins->width;
+    for(i32_idx = 0; i32_idx < pst_rpilcd->i32_width; i32_idx++) {
+      pst_rpilcd->apst_data[i32_idx] = rpilcd_request_gpio(dev, pst_pins->data[i32_idx],
+                                                           asz_data[8 - pst_rpilcd->i32_width + i32_idx]);
+    }
+    if(busyflag && pst_pins->rw >= 0) {
+      pst_rpilcd->pst_rw = rpilcd_request_gpio(dev, pst_pins->rw, "LCD_RW");
+    }
+    *pi32_rows = pst_pins->rows;
+    *pi32_cols = pst_pins->cols;
+  }
+  else {
+    return -EINVAL;
+  }
+
+  if(IS_ERR(pst_rpilcd->pst_rs)) {
+    return PTR_ERR(pst_rpilcd->pst_rs);
+  }
+  if(IS_ERR(pst_rpilcd->pst_en)) {
+    return PTR_ERR(pst_rpilcd->pst_en);
+  }
+  for(i32_idx = 0; i32_idx < pst_rpilcd->i32_width; i32_idx++) {
+    if(IS_ERR(pst_rpilcd->apst_data[i32_idx])) {
+      return PTR_ERR(pst_rpilcd->apst_data[i32_idx]);
+    }
+  }
+  if(IS_ERR(pst_rpilcd->pst_rw)) {
+    printk(KERN_WARNING "[RPILCD] Error request LCD_RW, busy flag disabled\n");
+    pst_rpilcd->pst_rw = (struct gpio_desc *)NULL;
+  }
+  pst_rpilcd->b_busyflag = (pst_rpilcd->pst_rw != NULL);
+
+  /* the hrtimer can only drive lines which do not sleep */
+  pst_rpilcd->b_timer = !gpiod_cansleep(pst_rpilcd->pst_rs) && !gpiod_cansleep(pst_rpilcd->pst_en);
+  for(i32_idx = 0; i32_idx < pst_rpilcd->i32_width; i32_idx++) {
+    pst_rpilcd->b_timer = pst_rpilcd->b_timer && !gpiod_cansleep(pst_rpilcd->apst_data[i32_idx]);
+  }
+
+  if(*pi32_rows < 1 || *pi32_rows > MAX_ROWS || *pi32_cols < 1 || *pi32_cols > MAX_LEN) {
+    printk(KERN_WARNING "[RPILCD] unsupported geometry %dx%d\n", *pi32_cols, *pi32_rows);
+    return -EINVAL;
+  }
+  return 0;
+}
+
+/*===============================================================================================*/
+/*
+ * delays of the bus, accounted in delayUs. A sleep is measured since it
+ * may last longer than asked.
+ */
+static void rpilcd_udelay(struct rpilcd_dev_t * const pst_rpilcd, const unsigned int ui32_us) {
+  udelay(ui32_us);
+  pst_rpilcd->delayUs += ui32_us;
+}
+
+static void rpilcd_usleep(struct rpilcd_dev_t * const pst_rpilcd,
+                          const unsigned long ui32_min, const unsigned long ui32_max) {
+  const ktime_t start = ktime_get();
+  usleep_range(ui32_min, ui32_max);
+  pst_rpilcd->delayUs += ktime_us_delta(ktime_get(), start);
+}
+
+/*===============================================================================================*/
+/*
+ * select instruction (0) or data (1) register
+ */
+void rpilcd_set_rs(struct rpilcd_dev_t * const pst_rpilcd, const int i32_level) {
+  if(pst_rpilcd->pst_rs != NULL) {
+    gpiod_set_value(pst_rpilcd->pst_rs, i32_level);
+  }
+  pst_rpilcd->i32_rs_level = i32_level;
+}
+
+/*===============================================================================================*/
+/*
+ * strobe the enable line to latch the data lines
+ */
+void rpilcd_pulse_enable(struct rpilcd_dev_t * const pst_rpilcd) {
+  gpiod_set_value(pst_rpilcd->pst_en, 1);
+  rpilcd_udelay(pst_rpilcd, 1);
+  gpiod_set_value(pst_rpilcd->pst_en, 0);
+}
+
+/*===============================================================================================*/
+/*
+ * put the low 4 or 8 bits of ui8_value on the data lines and latch them:
+ * a nibble on DB4..DB7 of a 4 bit bus, a byte on DB0..DB7 of an 8 bit bus
+ */
+static void rpilcd_gpio_put_nibble(struct rpilcd_dev_t * const pst_rpilcd,
+                                   const unsigned char /* in */ ui8_value) {
+  int ai32_values[8];
+  int i32_idx = 0;
+  for(i32_idx = 0; i32_idx < pst_rpilcd->i32_width; i32_idx++) {
+    ai32_values[i32_idx] = (ui8_value >> i32_idx) & 0x01;
+  }
+  gpiod_set_array_value(pst_rpilcd->i32_width, pst_rpilcd->apst_data, ai32_values);
+  rpilcd_pulse_enable(pst_rpilcd);
+  if(pst_rpilcd->i32_rs_level == 1) {
+    pst_rpilcd->dataNibbles++;
+  }
+  else {
+    pst_rpilcd->cmdNibbles++;
+  }
+}
+
+/*===============================================================================================*/
+/*
+ * wait the worst case execution time of the last byte
+ */
+void rpilcd_fixed_delay(struct rpilcd_dev_t * const pst_rpilcd) {
+  if(pst_rpilcd->i32_rs_level == 1) {
+    rpilcd_udelay(pst_rpilcd, EXEC_DATA_US);
+  }
+  else {
+    rpilcd_usleep(pst_rpilcd, EXEC_CMD_US, EXEC_CMD_US + 1000);
+  }
+}
+
+/*===============================================================================================*/
+/*
+ * the data lines while EN is high, the high nibble of a byte on a 4 bit bus
+ */
+static unsigned char rpilcd_read_lines(struct rpilcd_dev_t * const pst_rpilcd) {
+  unsigned char ui8_value = 0;
+  int i32_idx = 0;
+
+  gpiod_set_value(pst_rpilcd->pst_en, 1);
+  rpilcd_udelay(pst_rpilcd, 1);
+  for(i32_idx = 0; i32_idx < pst_rpilcd->i32_width; i32_idx++) {
+    if(gpiod_get_value(pst_rpilcd->apst_data[i32_idx]) == 1) {
+      ui8_value |= 1 << i32_idx;
+    }
+  }
+  gpiod_set_value(pst_rpilcd->pst_en, 0);
+  rpilcd_udelay(pst_rpilcd, 1);
+  return ui8_value;
+}
+
+/*===============================================================================================*/
+/*
+ * read the busy flag (bit 7) and the address counter once, the data
+ * lines are outputs again afterwards
+ */
+static unsigned char rpilcd_read_status(struct rpilcd_dev_t * const pst_rpilcd) {
+  const int i32_rs = pst_rpilcd->i32_rs_level;
+  unsigned char ui8_status = 0;
+  int i32_idx = 0;
+
+  for(i32_idx = 0; i32_idx < pst_rpilcd->i32_width; i32_idx++) {
+    gpiod_direction_input(pst_rpilcd->apst_data[i32_idx]);
+  }
+  rpilcd_set_rs(pst_rpilcd, 0);
+  gpiod_set_value(pst_rpilcd->pst_rw, 1);
+  if(pst_rpilcd->i32_width == 8) {
+    ui8_status = rpilcd_read_lines(pst_rpilcd);
+  }
+  else {
+    ui8_status = rpilcd_read_lines(pst_rpilcd) << 4;
+    ui8_status |= rpilcd_read_lines(pst_rpilcd);
+  }
+  gpiod_set_value(pst_rpilcd->pst_rw, 0);
+  for(i32_idx = 0; i32_idx < pst_rpilcd->i32_width; i32_idx++) {
+    gpiod_direction_output(pst_rpilcd->apst_data[i32_idx], 0);
+  }
+  rpilcd_set_rs(pst_rpilcd, i32_rs);
+  return ui8_status;
+}
+
+/*
+ * read the busy flag once
+ */
+bool rpilcd_read_busy(struct rpilcd_dev_t * const pst_rpilcd) {
+  return (rpilcd_read_status(pst_rpilcd) & 0x80) != 0;
+}
+
+/*===============================================================================================*/
+/*
+ * count a wait for the busy flag, too many timeouts in a row turn the
+ * busy flag mode off
+ */
+void rpilcd_busy_result(struct rpilcd_dev_t * const pst_rpilcd, const bool busy) {
+  if(!busy) {
+    pst_rpilcd->ui32_timeouts = 0;
+  }
+  else if(++pst_rpilcd->ui32_timeouts >= BUSY_MAX_TIMEOUTS) {
+    printk(KERN_WARNING "[RPILCD] rpilcd%d: busy flag never clears, using fixed delays\n",
+           pst_rpilcd->i32_minor);
+    pst_rpilcd->b_busyflag = false;
+  }
+}
+
+/*===============================================================================================*/
+/*
+ * poll the busy flag until the controller is ready, sleeping between two
+ * reads. Returns false on timeout, the caller then falls back to the
+ * fixed delay.
+ */
+bool rpilcd_wait_ready(struct rpilcd_dev_t * const pst_rpilcd) {
+  const ktime_t deadline = ktime_add_us(ktime_get(), BUSY_TIMEOUT_US);
+  bool busy = true;
+
+  busy = rpilcd_read_busy(pst_rpilcd);
+  while(busy && ktime_before(ktime_get(), deadline)) {
+    rpilcd_usleep(pst_rpilcd, BUSY_POLL_US, BUSY_POLL_US * 2);
+    busy = rpilcd_read_busy(pst_rpilcd);
+  }
+
+  rpilcd_busy_result(pst_rpilcd, busy);
+  return !busy;
+}
+
+/*===============================================================================================*/
+/*
+ * write a byte on the GPIO lines and wait until it is executed
+ */
+static void rpilcd_gpio_write_byte(struct rpilcd_dev_t * const pst_rpilcd,
+                                   const unsigned char /* in */ ui8_byte) {
+  if(pst_rpilcd->i32_width == 8) {
+    rpilcd_gpio_put_nibble(pst_rpilcd, ui8_byte);
+  }
+  else {
+    rpilcd_gpio_put_nibble(pst_rpilcd, ui8_byte >> 4);
+    if(pst_rpilcd->b_busyflag) {
+      /* the command runs after the second nibble, only the cycle time here */
+      rpilcd_udelay(pst_rpilcd, 1);
+    }
+    else {
+      rpilcd_fixed_delay(pst_rpilcd);
+    }
+    rpilcd_gpio_put_nibble(pst_rpilcd, ui8_byte & 0x0F);
+  }
+  if(!pst_rpilcd->b_busyflag || !rpilcd_wait_ready(pst_rpilcd)) {
+    rpilcd_fixed_delay(pst_rpilcd);
+  }
+}
+
+static const struct rpilcd_transport_t rpilcd_gpio_transport = {
+  .name       = "gpio",
+  .put_nibble = rpilcd_gpio_put_nibble,
+  .write_byte = rpilcd_gpio_write_byte,
+};
+
+/*===============================================================================================*/
+/*
+ * PCF8574 backpack, see rpilcd_pcf8574.c. A message goes out with one
+ * i2c_transfer(); adapters which only do SMBus (i2c-stub among them) get
+ * it as block writes, the first byte of each block in the command byte.
  */
-void rpilcd_write_byte(const unsigned char /* in */ ui8_byte) {
-  gpio_set_value(LCD_D4, (ui8_byte >> 4) & 0x01);
-  gpio_set_value(LCD_D5, (ui8_byte >> 5) & 0x01);
-  gpio_set_value(LCD_D6, (ui8_byte >> 6) & 0x01);
-  gpio_set_value(LCD_D7, (ui8_byte >> 7) & 0x01);
+static int rpilcd_i2c_xfer(void *ctx, const unsigned char *buf, unsigned int len,
+                           unsigned int waitUs) {
+  struct rpilcd_dev_t * const pst_rpilcd = ctx;
+  struct i2c_client * const client = pst_rpilcd->pst_client;
+  unsigned int off = 0;
+  int transfers = 0;
+  int ret = 0;
+
+  if(len > 0 && i2c_check_functionality(client->adapter, I2C_FUNC_I2C)) {
+    struct i2c_msg msg = {
+      .addr  = client->addr,
+      .flags = 0,
+      .len   = len,
+      .buf   = (u8 *)buf,
+    };
+    ret = i2c_transfer(client->adapter, &msg, 1);
+    ret = (ret == 1) ? 0 : ((ret < 0) ? ret : -EIO);
+    transfers = 1;
+  }
+  else if(i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_WRITE_I2C_BLOCK)) {
+    for(off = 0; off < len && ret == 0; off += 1 + I2C_SMBUS_BLOCK_MAX) {
+      const unsigned int n = min_t(unsigned int, len - off - 1, I2C_SMBUS_BLOCK_MAX);
+      ret = (n > 0) ? i2c_smbus_write_i2c_block_data(client, buf[off], n, &buf[off + 1])
+                    : i2c_smbus_write_byte(client, buf[off]);
+      transfers++;
+    }
+  }
+  else {
+    for(off = 0; off < len && ret == 0; off++) {
+      ret = i2c_smbus_write_byte(client, buf[off]);
+      transfers++;
+    }
+  }
+  if(ret < 0) {
+    printk(KERN_WARNING "[RPILCD] rpilcd%d: i2c write failed: %d\n", pst_rpilcd->i32_minor, ret);
+    return ret;
+  }
+  if(waitUs > 0) {
+    rpilcd_usleep(pst_rpilcd, waitUs, waitUs + 500);
+  }
+  return transfers;
+}
 
-  gpio_set_value(LCD_EN, 1);
-  udelay(1);
-  gpio_set_value(LCD_EN, 0);
-  if(gpio_get_value(LCD_RS) == 1) {
-    udelay(200);
+/*
+ * the init sequence waits between its nibbles, so they go out at once
+ */
+static void rpilcd_i2c_put_nibble(struct rpilcd_dev_t * const pst_rpilcd,
+                                  const unsigned char /* in */ ui8_value) {
+  rpilcd_pcf8574_nibble(&pst_rpilcd->pcf, pst_rpilcd->i32_rs_level, ui8_value);
+  rpilcd_pcf8574_flush(&pst_rpilcd->pcf);
+  if(pst_rpilcd->i32_rs_level == 1) {
+    pst_rpilcd->dataNibbles++;
   }
   else {
-    usleep_range(4500, 5500);
+    pst_rpilcd->cmdNibbles++;
   }
-  gpio_set_value(LCD_D4, ui8_byte & 0x01);
-  gpio_set_value(LCD_D5, (ui8_byte >> 1) & 0x01);
-  gpio_set_value(LCD_D6, (ui8_byte >> 2) & 0x01);
-  gpio_set_value(LCD_D7, (ui8_byte >> 3) & 0x01);
+}
 
-  gpio_set_value(LCD_EN, 1);
-  udelay(1);
-  gpio_set_value(LCD_EN, 0);
-  if(gpio_get_value(LCD_RS) == 1) {
-    udelay(200);
+static void rpilcd_i2c_write_byte(struct rpilcd_dev_t * const pst_rpilcd,
+                                  const unsigned char /* in */ ui8_byte) {
+  rpilcd_pcf8574_byte(&pst_rpilcd->pcf, pst_rpilcd->i32_rs_level, ui8_byte);
+  if(pst_rpilcd->i32_rs_level == 1) {
+    pst_rpilcd->dataNibbles += 2;
   }
   else {
-    usleep_range(4500, 5500);
+    pst_rpilcd->cmdNibbles += 2;
+  }
+}
+
+static void rpilcd_i2c_flush(struct rpilcd_dev_t * const pst_rpilcd) {
+  rpilcd_pcf8574_flush(&pst_rpilcd->pcf);
+}
+
+static const struct rpilcd_transport_t rpilcd_i2c_transport = {
+  .name       = "i2c",
+  .put_nibble = rpilcd_i2c_put_nibble,
+  .write_byte = rpilcd_i2c_write_byte,
+  .flush      = rpilcd_i2c_flush,
+};
+
+/*===============================================================================================*/
+/*
+ * put the low 4 or 8 bits of ui8_value on the data lines and latch them
+ */
+void rpilcd_put_nibble(struct rpilcd_dev_t * const pst_rpilcd,
+                       const unsigned char /* in */ ui8_value) {
+  pst_rpilcd->pst_transport->put_nibble(pst_rpilcd, ui8_value);
+}
+
+/*
+ * write a byte to lcd HD44780 controller
+ */
+void rpilcd_write_byte(struct rpilcd_dev_t * const pst_rpilcd,
+                       const unsigned char /* in */ ui8_byte) {
+  pst_rpilcd->pst_transport->write_byte(pst_rpilcd, ui8_byte);
+}
+
+/*
+ * send the bytes the transport still holds
+ */
+void rpilcd_transport_flush(struct rpilcd_dev_t * const pst_rpilcd) {
+  if(pst_rpilcd->pst_transport->flush != NULL) {
+    pst_rpilcd->pst_transport->flush(pst_rpilcd);
   }
 }
 
@@ -124,10 +776,11 @@ void rpilcd_write_byte(const unsigned char /* in */ ui8_byte) {
 /**
  * set current cursor position. Starts from row=1 and column=1
  */
-void rpilcd_set_cursor(const unsigned char /* in */ ui8_row,
+void rpilcd_set_cursor(struct rpilcd_dev_t * const pst_rpilcd,
+                       const unsigned char /* in */ ui8_row,
                        const unsigned char /* in */ ui8_column) {
   uint8_t ui8_command = 0x80;
-  gpio_set_value(LCD_RS, 0);
+  rpilcd_set_rs(pst_rpilcd, 0);
   switch(ui8_row) {
     case 1:
       ui8_command += ui8_column - 1;
@@ -139,7 +792,7 @@ void rpilcd_set_cursor(const unsigned char /* in */ ui8_row,
       break;
   }
 
-  rpilcd_write_byte(ui8_command);
+  rpilcd_write_byte(pst_rpilcd, ui8_command);
 }
 
 /*===============================================================================================*/
@@ -147,13 +800,13 @@ void rpilcd_set_cursor(const unsigned char /* in */ ui8_row,
 /*
  * Write a string of chars to the LCD
  */
-int rpilcd_put_string(const char * /* in */ sz_string) {
+int rpilcd_put_string(struct rpilcd_dev_t * const pst_rpilcd, const char * /* in */ sz_string) {
   if(sz_string != (char *)NULL) {
-    gpio_set_value(LCD_RS, 1);     // write characters
+    rpilcd_set_rs(pst_rpilcd, 1);     // write characters
     while(*sz_string != '\0') {
-      rpilcd_write_byte(*sz_string++);
+      rpilcd_write_byte(pst_rpilcd, *sz_string++);
     }
-    gpio_set_value(LCD_RS, 0);
+    rpilcd_set_rs(pst_rpilcd, 0);
     return 0;
   }
   else {
@@ -165,114 +818,133 @@ int rpilcd_put_string(const char * /* in */ sz_string) {
 /*
  * Write one character to the LCD
  */
-void rpilcd_put_char(const char /* in */ i8_char) {
-  gpio_set_value(LCD_RS, 1);     // write character
-  rpilcd_write_byte(i8_char);
-  gpio_set_value(LCD_RS, 0);
+void rpilcd_put_char(struct rpilcd_dev_t * const pst_rpilcd, const char /* in */ i8_char) {
+  rpilcd_set_rs(pst_rpilcd, 1);     // write character
+  rpilcd_write_byte(pst_rpilcd, i8_char);
+  rpilcd_set_rs(pst_rpilcd, 0);
 }
 
 /*===============================================================================================*/
 /*
  * clear HD44780 lcd controller
  */
-void rpilcd_clear_display(void) {
-  gpio_set_value(LCD_RS, 0);
-  rpilcd_write_byte(0x01);
+void rpilcd_clear_display(struct rpilcd_dev_t * const pst_rpilcd) {
+  rpilcd_set_rs(pst_rpilcd, 0);
+  rpilcd_write_byte(pst_rpilcd, 0x01);
+}
+
+/*===============================================================================================*/
+/*
+ * Trust the busy flag only when the address counter reads back after a
+ * set DDRAM address: with R/W floating or not wired to the panel the
+ * controller never drives the bus, and the flag reads "ready" or
+ * whatever the lines held last: the command itself, which has bit 7
+ * set, and on a 4 bit bus its low nibble twice, which neither address
+ * reads back as.
+ */
+static bool rpilcd_check_rw(struct rpilcd_dev_t * const pst_rpilcd) {
+  static const unsigned char aui8_addr[2] = { 0x0A, 0x45 };
+  unsigned char ui8_status = 0;
+  int i32_idx = 0;
+
+  for(i32_idx = 0; i32_idx < 2; i32_idx++) {
+    rpilcd_set_rs(pst_rpilcd, 0);
+    rpilcd_write_byte(pst_rpilcd, 0x80 | aui8_addr[i32_idx]);
+    ui8_status = rpilcd_read_status(pst_rpilcd);
+    if(ui8_status != aui8_addr[i32_idx]) {
+      printk(KERN_WARNING "[RPILCD] rpilcd%d: address 0x%02x read back as 0x%02x, R/W not "
+             "wired? Using fixed delays\n", pst_rpilcd->i32_minor, aui8_addr[i32_idx], ui8_status);
+      return false;
+    }
+  }
+  return true;
 }
 
 /*===============================================================================================*/
 /*
  * initialise HD44780 lcd controller
  */
-int rpilcd_init_display(void) {
+int rpilcd_init_display(struct rpilcd_dev_t * const pst_rpilcd) {
+  /* DL bit of function set, 8 bits interface */
+  const unsigned char ui8_dl = (pst_rpilcd->i32_width == 8) ? 0x10 : 0x00;
+  /* fixed delays until the R/W line is checked */
+  const bool b_busyflag = pst_rpilcd->b_busyflag;
   int i32_ret = 0;
+
+  pst_rpilcd->b_busyflag = false;
   /* Wait for more than 15 ms after VCC rises to 4.5 V */
-  usleep_range(15000, 16000);
+  rpilcd_usleep(pst_rpilcd, 15000, 16000);
 
   /*
    *  RS R/W DB7 DB6 DB5 DB4
    * 0   0   0   0   1   1
+   * the same three times for both widths, DB3..DB0 are ignored
    */
-  gpio_set_value(LCD_D4, 1);
-  gpio_set_value(LCD_D5, 1);
-  gpio_set_value(LCD_D6, 0);
-  gpio_set_value(LCD_D7, 0);
-
-  gpio_set_value(LCD_EN, 1);
-  udelay(1);
-  gpio_set_value(LCD_EN, 0);
+  rpilcd_put_nibble(pst_rpilcd, (pst_rpilcd->i32_width == 8) ? 0x30 : 0x03);
 
   /* Wait for more than 4.1 ms */
-  usleep_range(4200, 5000);
+  rpilcd_usleep(pst_rpilcd, 4200, 5000);
 
-  gpio_set_value(LCD_EN, 1);
-  udelay(1);
-  gpio_set_value(LCD_EN, 0);
+  rpilcd_put_nibble(pst_rpilcd, (pst_rpilcd->i32_width == 8) ? 0x30 : 0x03);
 
   /* Wait for more than 100 μs */
-  udelay(200);
-  gpio_set_value(LCD_EN, 1);
-  udelay(1);
-  gpio_set_value(LCD_EN, 0);
-  udelay(200);
-
-  // RS R/W DB7 DB6 DB5 DB4
-  // 0   0   0   0   1   0  => interface four bits mode
-  gpio_set_value(LCD_D4, 0);
-  gpio_set_value(LCD_D5, 1);
-  gpio_set_value(LCD_D6, 0);
-  gpio_set_value(LCD_D7, 0);
-
-  gpio_set_value(LCD_EN, 1);
-  udelay(1);
-  gpio_set_value(LCD_EN, 0);
-
-  usleep_range(4200, 5000);
-
-  /* => Set interface length - 4 bits, 2 lines
+  rpilcd_usleep(pst_rpilcd, 200, 300);
+  rpilcd_put_nibble(pst_rpilcd, (pst_rpilcd->i32_width == 8) ? 0x30 : 0x03);
+  rpilcd_usleep(pst_rpilcd, 200, 300);
+
+  if(pst_rpilcd->i32_width == 4) {
+    // RS R/W DB7 DB6 DB5 DB4
+    // 0   0   0   0   1   0  => interface four bits mode
+    rpilcd_put_nibble(pst_rpilcd, 0x02);
+
+    rpilcd_usleep(pst_rpilcd, 4200, 5000);
+  }
+
+  /* => Set interface length - 4 or 8 bits, 2 lines (also 4 line panels)
    * RS R/W DB7 DB6 DB5 DB4
-   * 0   0   0   0   1   0
+   * 0   0   0   0   1   DL
    * 0   0   N   F   *   *
    */
-  rpilcd_write_byte(0x28);
+  rpilcd_write_byte(pst_rpilcd, ui8_dl | ((pst_rpilcd->core.rows > 1) ? 0x28 : 0x20));
 
   /* => Display Off
    * RS R/W DB7 DB6 DB5 DB4
    * 0   0   0   0   0   0
    * 0   0   1   0   0   0
    */
-  rpilcd_write_byte(0x08);
+  rpilcd_write_byte(pst_rpilcd, 0x08);
 
   /* => Clear screen
    * RS R/W DB7 DB6 DB5 DB4
    * 0   0   0   0   0   0
    * 0   0   0   0   0   1
    */
-  rpilcd_write_byte(0x01);
+  rpilcd_write_byte(pst_rpilcd, 0x01);
 
   /* => Set entry Mode
    * RS R/W DB7 DB6 DB5 DB4
    * 0   0   0   0   0   0
    * 0   0   0   1   D   S
    */
-  rpilcd_write_byte(0x06);
+  rpilcd_write_byte(pst_rpilcd, 0x06);
 
   /* RS R/W DB7 DB6 DB5 DB4 - on LCD without cursor
    * 0   0   0   0   0   0
    * 0   0   1   D   C   B
    */
-  //rpilcd_write_byte(0x0C);
+  //rpilcd_write_byte(pst_rpilcd, 0x0C);
   /* RS R/W DB7 DB6 DB5 DB4 - on LCD cursor on, blinking on
    * 0   0   0   0   0   0
    * 0   0   1   1   1   1
    */
-  //rpilcd_write_byte(0x0F);
+  //rpilcd_write_byte(pst_rpilcd, 0x0F);
   /* RS R/W DB7 DB6 DB5 DB4 - on LCD cursor on, blinking off
    * 0   0   0   0   0   0
    * 0   0   1   1   1   0
    */
-  rpilcd_write_byte(0x0E);
+  rpilcd_write_byte(pst_rpilcd, 0x0E);
 
+  pst_rpilcd->b_busyflag = b_busyflag && rpilcd_check_rw(pst_rpilcd);
 
   return i32_ret;
 }
@@ -313,14 +985,34 @@ int rpilcd_atoi(const char * const buf, const size_t count, int * const pi32_val
   return 0;
 }
 
+/*===============================================================================================*/
+/*
+ * Last reference of a panel gone, see rpilcd_teardown()
+ */
+static void rpilcd_free(struct kref *ref) {
+  struct rpilcd_dev_t * const pst_rpilcd = container_of(ref, struct rpilcd_dev_t, st_ref);
+  free_page((unsigned long)pst_rpilcd->pst_map);
+  kfree(pst_rpilcd);
+}
+
 /*===============================================================================================*/
 /*
  * Open method
  */
 int rpilcd_open(struct inode *inode, struct file *filp) {
   struct rpilcd_dev_t * pst_rpilcd = (struct rpilcd_dev_t *)NULL;
-  printk(KERN_INFO "[RPILCD] rpilcd_open\n");
-  pst_rpilcd = container_of(inode->i_cdev, struct rpilcd_dev_t, st_cdev);
+  pr_debug("[RPILCD] rpilcd_open\n");
+  mutex_lock(&gst_rpilcd_lock);
+  if (iminor(inode) < RPILCD_MAX_DEVICES) {
+    pst_rpilcd = apst_rpilcd[iminor(inode)];
+  }
+  if (pst_rpilcd != (struct rpilcd_dev_t *)NULL) {
+    kref_get(&pst_rpilcd->st_ref);
+  }
+  mutex_unlock(&gst_rpilcd_lock);
+  if (pst_rpilcd == (struct rpilcd_dev_t *)NULL) {
+    return -ENODEV;
+  }
   /* store pointer to it in the private_data field of the file structure
 * for easier access in the future */
   filp->private_data = pst_rpilcd;
@@ -332,195 +1024,1038 @@ int rpilcd_open(struct inode *inode, struct file *filp) {
  * Release method
  */
 int rpilcd_release(struct inode *inode, struct file *filp) {
-  printk(KERN_INFO "[RPILCD] rpilcd_release\n");
+  struct rpilcd_dev_t * const pst_rpilcd = filp->private_data;
+  pr_debug("[RPILCD] rpilcd_release\n");
+  kref_put(&pst_rpilcd->st_ref, rpilcd_free);
   return 0;
 }
 
 /*===============================================================================================*/
 /*
- * Read method
+ * Read method, returns the last published snapshot of the glass
  */
 ssize_t rpilcd_read(struct file *filp, char __user *buff, size_t count, loff_t *offp) {
   /* retreive pointer from private data */
-  struct rpilcd_dev_t * pst_rpilcd = filp->private_data;
-  printk(KERN_INFO "[RPILCD] rpilcd_read\n");
-  size_t i32_ret = -1;
-
-  //~ i32_ret = gpio_get_value(PIN_LED);
-  //~ pst_rpilcd->ui8_value = (unsigned char)i32_ret;
-  //~ snprintf(sz_value, sizeof(sz_value), "%d\n", pst_rpilcd->ui8_value);
-  //~ i32_ret = sizeof(sz_value) + 1;
-  //~
-  //~ if(i32_ret > count) {
-          //~ return -ENOMEM;
-  //~ }
-  //~ /* else nothing to do */
-
-  //~ if(copy_to_user(buff, sz_value, i32_ret)) {
-          //~ return -EFAULT;
-  //~ }
-  //~ /* else nothing to do */
-
-  return i32_ret;
+  struct rpilcd_dev_t * const pst_rpilcd = filp->private_data;
+  char snapshot[RPILCD_SNAPSHOT_MAX];
+  size_t len = 0;
+  unsigned int seq = 0;
+
+  spin_lock(&pst_rpilcd->snapLock);
+  len = pst_rpilcd->snapLen;
+  memcpy(snapshot, pst_rpilcd->snapshot, len);
+  seq = pst_rpilcd->snapSeq;
+  spin_unlock(&pst_rpilcd->snapLock);
+
+  if (*offp == 0) {
+    filp->f_version = seq;
+  }
+  if (*offp < 0 || *offp >= len) {
+    return 0;
+  }
+  count = min_t(size_t, count, len - *offp);
+  if (copy_to_user(buff, &snapshot[*offp], count) != 0) {
+    return -EFAULT;
+  }
+  *offp += count;
+  return count;
 }
 
 /*===============================================================================================*/
-#define MAX_LEN 16
-int curRow = 1;
-int curCol = 1;
-int col1len = 0;
-int col2len = 0;
-char line1[MAX_LEN+1] = "";
-char line2[MAX_LEN+1] = "";
+/*
+ * Llseek method, the snapshot has a fixed size for a panel
+ */
+loff_t rpilcd_llseek(struct file *filp, loff_t off, int whence) {
+  struct rpilcd_dev_t * const pst_rpilcd = filp->private_data;
+  return fixed_size_llseek(filp, off, whence, READ_ONCE(pst_rpilcd->snapLen));
+}
 
-ssize_t rpilcd_write(struct file *filp, const char __user *buff, size_t count, loff_t *offp) {
-  bool ctrl = false;
-  int buffCount = count;
-
-  printk(KERN_INFO "[RPILCD] write (%d) %s\n", count, buff);
-  printk(KERN_INFO "[RPILCD] BEFORE WRITE Line1(%d, %d) %s\n", col1len, curCol, line1);
-  printk(KERN_INFO "[RPILCD] BEFORE WRITE Line2(%d, %d) %s\n", col2len, curCol, line2);
-  //rpilcd_clear_display();
-  //rpilcd_set_cursor(1, 1);
-
-  if (count == 3) {
-    printk(KERN_INFO "[RPILCD] potentially control character: %s\n", buff);
-    if (strncmp("\\n", buff, 2) == 0) {
-      if (curRow == 1) {
-        curRow = 2;
-        curCol = 1 + col2len;
-      }
-      ctrl = true;
-    }
-    if (strncmp("\\p", buff, 2) == 0) {
-      if (curRow == 2) {
-        curRow = 1;
-        curCol = 1 + col1len;
-      }
-      ctrl = true;
-    }
-    if (strncmp("\\r", buff, 2) == 0) {
-      if ((curRow == 1 && curCol) < col1len+1 || (curRow == 2 && curCol) < col2len+1) {
-        curCol += 1;
-      }
-      ctrl = true;
-    }
-    if (strncmp("\\l", buff, 2) == 0) {
-      if (curCol > 1) {
-        curCol -= 1;
-      }
-      ctrl = true;
-    }
-    if (strncmp("\\d", buff, 2) == 0) {
-      if (curCol > 1) {
-        if (curRow == 1) {
-          if (curCol-1==col1len) {
-            line1[curCol-2] = '\0';
-            col1len -= 1;
-            curCol -= 1;
-          }
-          else {
-            strcpy(line1+curCol-1,line1+curCol);
-            col1len -= 1;
-          }
-        }
-        else if (curRow == 2) {
-          if (curCol-1==col2len) {
-            line2[curCol-2] = '\0';
-            col2len -= 1;
-            curCol -= 1;
-          }
-          else {
-            strcpy(line2+curCol-1,line2+curCol);
-            col2len -= 1;
-          }
-        }
-      }
-      else {
-        if (curRow == 1) {
-          line1[curCol-1] = '\0';
-        }
-        else {
-          line2[curCol-1] = '\0';
-        }
-      }
-      ctrl = true;
-    }
-    if (strncmp("\\c", buff, 2) == 0) {
-      strcpy(line1, "");
-      col1len = 0;
-      strcpy(line2, "");
-      col2len = 0;
-      curRow = 1;
-      curCol = 1;
-      ctrl = true;
-    }
-  }
+/*===============================================================================================*/
+/*
+ * Bus of the text model, see rpilcd_core.c
+ */
+static void rpilcd_tx_run(struct rpilcd_dev_t * const pst_rpilcd);
 
-  if (!ctrl) {
-    char msg[MAX_LEN*2+1] = "";
-    if (count > MAX_LEN) {
-      count = MAX_LEN;
-    }
-    if (copy_from_user(msg, buff, count) != 0) {
-      printk(KERN_ALERT "[RPILCD] Copy string failed\n");
-      return -EFAULT;
-    }
-    msg[count] = '\0';
-    size_t msglen = strlen(msg);
-    printk(KERN_INFO "[Simple-driver] Buffer (len: %d): %s\n", msglen, msg);
-    if (curRow == 2 && curCol+msglen-1 > MAX_LEN) {
-      msg[MAX_LEN-curCol+1] = '\0';
-    }
-    else if (curRow == 1 && curCol+msglen-1 > MAX_LEN*2) {
-      msg[MAX_LEN*2-curCol+1] = '\0';
-    }
-    if (curRow == 1) {
-      if (curCol+msglen-1 > MAX_LEN) {
-        int ctoline1 = MAX_LEN-(curCol-1);
-        strncpy(line1+curCol-1, msg, ctoline1);
-        curRow = 2;
-        curCol = 1;
-        strcpy(line2, msg+ctoline1);
-        curCol = msglen-ctoline1;
-      }
-      else {
-        strcpy(line1+curCol-1, msg);
-        curCol += strlen(msg) - 1;
-        col1len = strlen(line1) - 1;
-      }
-    }
-    else if (curRow == 2) {
-      strcpy(line2+curCol-1, msg);
-      curCol += strlen(msg) - 1;
-      col2len = strlen(line2) -1;
+static void rpilcd_bus_write(void *ctx, int rs, unsigned char byte) {
+  struct rpilcd_dev_t * const pst_rpilcd = ctx;
+  if(pst_rpilcd->b_txActive) {
+    if(pst_rpilcd->txTail - pst_rpilcd->txHead >= TX_LEN) {
+      rpilcd_tx_run(pst_rpilcd);
     }
+    pst_rpilcd->txBuf[pst_rpilcd->txTail % TX_LEN].rs = rs;
+    pst_rpilcd->txBuf[pst_rpilcd->txTail % TX_LEN].byte = byte;
+    pst_rpilcd->txTail++;
+    return;
   }
+  rpilcd_set_rs(pst_rpilcd, rs);
+  rpilcd_write_byte(pst_rpilcd, byte);
+  rpilcd_set_rs(pst_rpilcd, 0);
+}
 
-  printk(KERN_INFO "[RPILCD] AFTER WRITE current ROW: %d\n", curRow);
-  printk(KERN_INFO "[RPILCD] AFTER WRITE Line1(len=%d, curCol=%d) %s\n", col1len, curCol, line1);
-  printk(KERN_INFO "[RPILCD] AFTER WRITE Line2(len=%d, curCol=%d) %s\n", col2len, curCol, line2);
-
-  rpilcd_clear_display();
-  rpilcd_set_cursor(1, 1);
-  rpilcd_put_string(line1);
-  rpilcd_set_cursor(2, 1);
-  rpilcd_put_string(line2);
-  rpilcd_set_cursor(curRow, curCol);
+static const struct rpilcd_bus_t rpilcd_bus = {
+  .write = rpilcd_bus_write,
+};
 
-  return buffCount;
-}
-/*===============================================================================================*/
+/*
+ * State machine sending txBuf, one byte per expiry. After a byte the timer
+ * waits the fixed execution time. Runs in hardirq context, so only lines
+ * which cannot sleep are driven from here, and their direction is never
+ * changed: the busy flag is read from the worker, see rpilcd_wait_ready().
+ */
+static enum hrtimer_restart rpilcd_tx_timer(struct hrtimer *timer) {
+  struct rpilcd_dev_t * const pst_rpilcd = container_of(timer, struct rpilcd_dev_t, st_timer);
+  const struct rpilcd_tx_t *tx;
+
+  pst_rpilcd->timerCallbacks++;
+  if (pst_rpilcd->txHead == pst_rpilcd->txTail) {
+    complete(&pst_rpilcd->st_txDone);
+    return HRTIMER_NORESTART;
+  }
+
+  tx = &pst_rpilcd->txBuf[pst_rpilcd->txHead % TX_LEN];
+  pst_rpilcd->txHead++;
+  rpilcd_set_rs(pst_rpilcd, tx->rs);
+  if (pst_rpilcd->i32_width == 8) {
+    rpilcd_gpio_put_nibble(pst_rpilcd, tx->byte);
+  }
+  else {
+    rpilcd_gpio_put_nibble(pst_rpilcd, tx->byte >> 4);
+    rpilcd_udelay(pst_rpilcd, 1);
+    rpilcd_gpio_put_nibble(pst_rpilcd, tx->byte & 0x0F);
+  }
+
+  hrtimer_forward_now(timer, ns_to_ktime((u64)(tx->rs ? EXEC_DATA_US : EXEC_CMD_US) *
+                                         NSEC_PER_USEC));
+  return HRTIMER_RESTART;
+}
+
+/*
+ * Send what is in txBuf and sleep until the controller has executed it
+ */
+static void rpilcd_tx_run(struct rpilcd_dev_t * const pst_rpilcd) {
+  if (pst_rpilcd->txHead == pst_rpilcd->txTail) {
+    return;
+  }
+  reinit_completion(&pst_rpilcd->st_txDone);
+  hrtimer_start(&pst_rpilcd->st_timer, ktime_set(0, 0), HRTIMER_MODE_REL);
+  wait_for_completion(&pst_rpilcd->st_txDone);
+  rpilcd_set_rs(pst_rpilcd, 0);
+}
+
+/*
+ * Take the queue lock or the bus, counting how often they were held
+ */
+static void rpilcd_lock_req(struct rpilcd_dev_t * const pst_rpilcd) {
+  if (!spin_trylock(&pst_rpilcd->reqLock)) {
+    spin_lock(&pst_rpilcd->reqLock);
+    pst_rpilcd->lockContended++;
+  }
+}
+
+static void rpilcd_lock_bus(struct rpilcd_dev_t * const pst_rpilcd) {
+  if (!mutex_trylock(&pst_rpilcd->busLock)) {
+    mutex_lock(&pst_rpilcd->busLock);
+    pst_rpilcd->busContended++;
+  }
+}
+
+/*
+ * Publish the glass for read() and wake the readers when it changed
+ */
+static void rpilcd_publish(struct rpilcd_dev_t * const pst_rpilcd) {
+  char snapshot[RPILCD_SNAPSHOT_MAX];
+  const size_t len = rpilcd_core_snapshot(&pst_rpilcd->core, snapshot);
+  bool changed = false;
+
+  spin_lock(&pst_rpilcd->snapLock);
+  if (len != pst_rpilcd->snapLen || memcmp(snapshot, pst_rpilcd->snapshot, len) != 0) {
+    memcpy(pst_rpilcd->snapshot, snapshot, len);
+    pst_rpilcd->snapLen = len;
+    pst_rpilcd->snapSeq++;
+    changed = true;
+  }
+  spin_unlock(&pst_rpilcd->snapLock);
+
+  if (changed) {
+    wake_up_interruptible(&pst_rpilcd->readWait);
+  }
+}
+
+/*
+ * Take the dirty cells and the cursor from the mapped buffer. The
+ * application may be writing it meanwhile: a bit set after the xchg()
+ * stays for the next flush, so no update is lost.
+ */
+static void rpilcd_apply_map(struct rpilcd_dev_t * const pst_rpilcd) {
+  struct rpilcd_map * const pst_map = pst_rpilcd->pst_map;
+  unsigned int mask = 0;
+  int row = 0;
+
+  for (row = 0; row < pst_rpilcd->core.rows; row++) {
+    mask = xchg(&pst_map->dirty[row], 0);
+    if (mask != 0) {
+      rpilcd_core_apply_cells(&pst_rpilcd->core, row + 1, mask, pst_map->cells[row]);
+    }
+  }
+  if (READ_ONCE(pst_map->row) != 0) {
+    rpilcd_core_set_cursor(&pst_rpilcd->core, READ_ONCE(pst_map->row), READ_ONCE(pst_map->col));
+  }
+}
+
+/*
+ * Count the queue to glass latency of a request in the histogram
+ */
+static void rpilcd_account_latency(struct rpilcd_dev_t * const pst_rpilcd, const ktime_t queued,
+                                   const ktime_t drawn) {
+  const s64 ms = ktime_ms_delta(drawn, queued);
+  int bucket = 0;
+
+  while (bucket < LATENCY_BUCKETS - 1 && ms >= (1LL << bucket)) {
+    bucket++;
+  }
+  pst_rpilcd->latencyHist[bucket]++;
+}
+
+/*
+ * Worker draining the request queue of one panel. Every panel has its own
+ * ordered workqueue, so panels are drawn in parallel. At most QUEUE_LEN
+ * requests are applied per run, the worker requeues itself for the rest.
+ * The flush waits for the last chunk of a write(), so a whole write() is
+ * drawn at once; a write() only counts once in the latency histogram.
+ */
+static void rpilcd_work_fn(struct work_struct *work) {
+  struct rpilcd_dev_t * const pst_rpilcd = container_of(work, struct rpilcd_dev_t, st_work);
+  struct rpilcd_core_t * const core = &pst_rpilcd->core;
+  struct rpilcd_req_t req;
+  unsigned int applied = 0;
+  unsigned int head = 0;
+  unsigned int bytes = 0;
+  bool more = false;
+  bool flush = false;
+  bool marquee = false;
+
+  rpilcd_lock_req(pst_rpilcd);
+  while (pst_rpilcd->reqHead != pst_rpilcd->reqTail && applied < QUEUE_LEN) {
+    req = pst_rpilcd->reqQueue[pst_rpilcd->reqHead % QUEUE_LEN];
+    pst_rpilcd->reqHead++;
+    if (req.type == REQ_WRITE) {
+      pst_rpilcd->b_midWrite = req.more;
+    }
+    spin_unlock(&pst_rpilcd->reqLock);
+    wake_up_interruptible(&pst_rpilcd->reqWait);
+    trace_rpilcd_parse(pst_rpilcd->i32_minor, req.type, req.count);
+    switch (req.type) {
+      case REQ_FRAME:
+        rpilcd_core_apply_frame(core, &req.frame);
+        break;
+      case REQ_MAP:
+        rpilcd_apply_map(pst_rpilcd);
+        break;
+      case REQ_GLYPH:
+        rpilcd_core_put_glyph(core, &req.glyph);
+        break;
+      case REQ_BARS:
+        rpilcd_core_apply_bars(core, &req.bars);
+        break;
+      case REQ_MARQUEE:
+        rpilcd_core_apply_marquee(core, &req.marquee);
+        marquee = true;
+        break;
+      default:
+        rpilcd_core_apply_write(core, req.data, req.count);
+        break;
+    }
+    applied++;
+    pst_rpilcd->pending++;
+    if (!(req.type == REQ_WRITE && req.more) && pst_rpilcd->pendingTimes < QUEUE_LEN) {
+      pst_rpilcd->pendingQueued[pst_rpilcd->pendingTimes++] = req.queued;
+    }
+    rpilcd_lock_req(pst_rpilcd);
+  }
+  head = pst_rpilcd->reqHead;
+  more = (pst_rpilcd->reqHead != pst_rpilcd->reqTail);
+  flush = !pst_rpilcd->b_midWrite && pst_rpilcd->pending > 0;
+  spin_unlock(&pst_rpilcd->reqLock);
+
+  if (flush) {
+    const ktime_t start = ktime_get();
+    ktime_t end;
+    s64 us;
+    unsigned int idx;
+    trace_rpilcd_flush_start(pst_rpilcd->i32_minor, pst_rpilcd->pending);
+    rpilcd_lock_bus(pst_rpilcd);
+    pst_rpilcd->b_txActive = pst_rpilcd->b_timer && !pst_rpilcd->b_busyflag && READ_ONCE(txtimer);
+    bytes = rpilcd_core_flush(core);
+    rpilcd_tx_run(pst_rpilcd);
+    rpilcd_transport_flush(pst_rpilcd);
+    pst_rpilcd->b_txActive = false;
+    mutex_unlock(&pst_rpilcd->busLock);
+    end = ktime_get();
+    us = ktime_us_delta(end, start);
+    trace_rpilcd_flush_end(pst_rpilcd->i32_minor, bytes, us);
+    rpilcd_publish(pst_rpilcd);
+
+    pst_rpilcd->flushes++;
+    pst_rpilcd->coalesced += pst_rpilcd->pending - 1;
+    for (idx = 0; idx < pst_rpilcd->pendingTimes; idx++) {
+      rpilcd_account_latency(pst_rpilcd, pst_rpilcd->pendingQueued[idx], end);
+    }
+    pr_debug("[RPILCD] rpilcd%d flush: %u requests, %u bytes on bus in %lld us (%lld bytes/s)\n",
+             pst_rpilcd->i32_minor, pst_rpilcd->pending, bytes, us,
+             us > 0 ? div_s64((s64)bytes * USEC_PER_SEC, us) : 0);
+    pr_debug("[RPILCD] rpilcd%d glyphs: %u hits, %u uploads, %u misses\n",
+             pst_rpilcd->i32_minor, core->glyphHits, core->glyphUploads, core->glyphMisses);
+    pst_rpilcd->pending = 0;
+    pst_rpilcd->pendingTimes = 0;
+  }
+
+  /* a new marquee starts its steps over, a stopped one has none left */
+  if (marquee && core->marquee.active) {
+    mod_delayed_work(pst_rpilcd->wq, &pst_rpilcd->st_marquee,
+                     msecs_to_jiffies(core->marquee.period));
+  }
+  else if (marquee) {
+    cancel_delayed_work(&pst_rpilcd->st_marquee);
+  }
+
+  /* the chunks of an unfinished write() are not on the glass yet */
+  if (flush) {
+    rpilcd_lock_req(pst_rpilcd);
+    pst_rpilcd->reqDone = head;
+    spin_unlock(&pst_rpilcd->reqLock);
+    wake_up_interruptible(&pst_rpilcd->reqWait);
+  }
+
+  if (more) {
+    queue_work(pst_rpilcd->wq, &pst_rpilcd->st_work);
+  }
+}
+
+/*
+ * One step of the marquee: a single shift command, the text stays in
+ * DDRAM. After the last step the worker puts the lines back, once the
+ * write() it may be in the middle of is complete.
+ */
+static void rpilcd_marquee_fn(struct work_struct *work) {
+  struct rpilcd_dev_t * const pst_rpilcd = container_of(to_delayed_work(work),
+                                                        struct rpilcd_dev_t, st_marquee);
+  struct rpilcd_core_t * const core = &pst_rpilcd->core;
+  bool running = false;
+
+  rpilcd_lock_bus(pst_rpilcd);
+  running = rpilcd_core_marquee_step(core);
+  rpilcd_transport_flush(pst_rpilcd);
+  mutex_unlock(&pst_rpilcd->busLock);
+  rpilcd_publish(pst_rpilcd);
+
+  if (running) {
+    queue_delayed_work(pst_rpilcd->wq, &pst_rpilcd->st_marquee,
+                       msecs_to_jiffies(core->marquee.period));
+  }
+  else if (core->marquee.unload) {
+    pst_rpilcd->pending++;
+    queue_work(pst_rpilcd->wq, &pst_rpilcd->st_work);
+  }
+}
+
+static bool rpilcd_queue_full(struct rpilcd_dev_t * const pst_rpilcd) {
+  bool full;
+  rpilcd_lock_req(pst_rpilcd);
+  full = (pst_rpilcd->reqTail - pst_rpilcd->reqHead) >= QUEUE_LEN;
+  spin_unlock(&pst_rpilcd->reqLock);
+  return full;
+}
+
+static bool rpilcd_drawn(struct rpilcd_dev_t * const pst_rpilcd, const unsigned int seq) {
+  bool drawn;
+  rpilcd_lock_req(pst_rpilcd);
+  drawn = (int)(pst_rpilcd->reqDone - seq) >= 0;
+  spin_unlock(&pst_rpilcd->reqLock);
+  return drawn;
+}
+
+/*
+ * Put a request on the queue of the panel and kick its worker, its
+ * position in the queue goes to pui32_seq if not NULL
+ */
+static int rpilcd_enqueue(struct file *filp, const struct rpilcd_req_t *req,
+                          unsigned int * const pui32_seq) {
+  struct rpilcd_dev_t * const pst_rpilcd = filp->private_data;
+
+  rpilcd_lock_req(pst_rpilcd);
+  while ((pst_rpilcd->reqTail - pst_rpilcd->reqHead) >= QUEUE_LEN) {
+    if (filp->f_flags & O_NONBLOCK) {
+      spin_unlock(&pst_rpilcd->reqLock);
+      return -EAGAIN;
+    }
+    pst_rpilcd->queueWaits++;
+    spin_unlock(&pst_rpilcd->reqLock);
+    if (wait_event_interruptible(pst_rpilcd->reqWait, !rpilcd_queue_full(pst_rpilcd))) {
+      return -ERESTARTSYS;
+    }
+    rpilcd_lock_req(pst_rpilcd);
+  }
+  pst_rpilcd->reqQueue[pst_rpilcd->reqTail % QUEUE_LEN] = *req;
+  pst_rpilcd->reqQueue[pst_rpilcd->reqTail % QUEUE_LEN].queued = ktime_get();
+  if (pui32_seq != NULL) {
+    *pui32_seq = pst_rpilcd->reqTail;
+  }
+  pst_rpilcd->reqTail++;
+  pst_rpilcd->writes++;
+  spin_unlock(&pst_rpilcd->reqLock);
+
+  queue_work(pst_rpilcd->wq, &pst_rpilcd->st_work);
+
+  return 0;
+}
+
+/*
+ * A write() stopped before its last chunk: seq is the last chunk it
+ * queued. Still queued, that chunk ends the write; already taken, the
+ * worker is mid write since writeLock kept other writes out, and flushes
+ * what it has applied.
+ */
+static void rpilcd_end_write(struct rpilcd_dev_t * const pst_rpilcd, const unsigned int seq) {
+  rpilcd_lock_req(pst_rpilcd);
+  if ((int)(seq - pst_rpilcd->reqHead) >= 0) {
+    pst_rpilcd->reqQueue[seq % QUEUE_LEN].more = false;
+  }
+  else {
+    pst_rpilcd->b_midWrite = false;
+  }
+  spin_unlock(&pst_rpilcd->reqLock);
+  queue_work(pst_rpilcd->wq, &pst_rpilcd->st_work);
+}
+
+/*
+ * The chunks of one write() must follow each other on the queue, the
+ * other requests wait for the write in progress. Fails once the panel
+ * is unbound.
+ */
+static int rpilcd_lock_write(struct file *filp) {
+  struct rpilcd_dev_t * const pst_rpilcd = filp->private_data;
+
+  if (filp->f_flags & O_NONBLOCK) {
+    if (!mutex_trylock(&pst_rpilcd->writeLock)) {
+      return -EAGAIN;
+    }
+  }
+  else if (mutex_lock_interruptible(&pst_rpilcd->writeLock)) {
+    return -ERESTARTSYS;
+  }
+  if (pst_rpilcd->b_gone) {
+    mutex_unlock(&pst_rpilcd->writeLock);
+    return -ENODEV;
+  }
+  return 0;
+}
+
+/*
+ * Queue a request which is not part of a write()
+ */
+static int rpilcd_enqueue_one(struct file *filp, const struct rpilcd_req_t *req) {
+  struct rpilcd_dev_t * const pst_rpilcd = filp->private_data;
+  int i32_ret = rpilcd_lock_write(filp);
+
+  if (i32_ret != 0) {
+    return i32_ret;
+  }
+  i32_ret = rpilcd_enqueue(filp, req, NULL);
+  mutex_unlock(&pst_rpilcd->writeLock);
+  return i32_ret;
+}
+
+/*
+ * Write method: the buffer goes to the worker in chunks, text and control
+ * sequences are parsed there, see rpilcd_core_apply_write()
+ */
+ssize_t rpilcd_write(struct file *filp, const char __user *buff, size_t count, loff_t *offp) {
+  struct rpilcd_dev_t * const pst_rpilcd = filp->private_data;
+  struct rpilcd_req_t req;
+  size_t done = 0;
+  unsigned int seq = 0;
+  int i32_ret = 0;
+
+  trace_rpilcd_write(pst_rpilcd->i32_minor, count);
+  if (count == 0) {
+    return 0;
+  }
+
+  i32_ret = rpilcd_lock_write(filp);
+  if (i32_ret != 0) {
+    return i32_ret;
+  }
+
+  req.type = REQ_WRITE;
+  while (done < count) {
+    req.count = min_t(size_t, count - done, WRITE_CHUNK);
+    req.more = (done + req.count < count);
+    if (copy_from_user(req.data, buff + done, req.count) != 0) {
+      printk(KERN_ALERT "[RPILCD] Copy string failed\n");
+      i32_ret = -EFAULT;
+      break;
+    }
+    i32_ret = rpilcd_enqueue(filp, &req, &seq);
+    if (i32_ret != 0) {
+      break;
+    }
+    done += req.count;
+  }
+  if (done > 0 && done < count) {
+    rpilcd_end_write(pst_rpilcd, seq);
+  }
+  mutex_unlock(&pst_rpilcd->writeLock);
+
+  if (done > 0) {
+    return done;
+  }
+  return i32_ret;
+}
+
+/*===============================================================================================*/
+/*
+ * Ioctl method
+ */
+long rpilcd_ioctl(struct file *filp, unsigned int cmd, unsigned long arg) {
+  struct rpilcd_dev_t * const pst_rpilcd = filp->private_data;
+  struct rpilcd_req_t req;
+
+  switch (cmd) {
+    case RPILCD_IOC_SET_FRAME:
+      req.type = REQ_FRAME;
+      req.count = sizeof(req.frame);
+      if (copy_from_user(&req.frame, (const void __user *)arg, sizeof(req.frame)) != 0) {
+        return -EFAULT;
+      }
+      return rpilcd_enqueue_one(filp, &req);
+    case RPILCD_IOC_PUT_GLYPH:
+      req.type = REQ_GLYPH;
+      req.count = sizeof(req.glyph);
+      if (copy_from_user(&req.glyph, (const void __user *)arg, sizeof(req.glyph)) != 0) {
+        return -EFAULT;
+      }
+      return rpilcd_enqueue_one(filp, &req);
+    case RPILCD_IOC_BARS:
+      req.type = REQ_BARS;
+      req.count = sizeof(req.bars);
+      if (copy_from_user(&req.bars, (const void __user *)arg, sizeof(req.bars)) != 0) {
+        return -EFAULT;
+      }
+      return rpilcd_enqueue_one(filp, &req);
+    case RPILCD_IOC_MARQUEE:
+      /* the geometry never changes, no lock needed */
+      if (pst_rpilcd->core.rows > 2) {
+        return -EINVAL;
+      }
+      req.type = REQ_MARQUEE;
+      req.count = sizeof(req.marquee);
+      if (copy_from_user(&req.marquee, (const void __user *)arg, sizeof(req.marquee)) != 0) {
+        return -EFAULT;
+      }
+      return rpilcd_enqueue_one(filp, &req);
+    case RPILCD_IOC_FLUSH_MAP:
+      /* the cells are read by the worker, so it draws the newest ones */
+      req.type = REQ_MAP;
+      req.count = 0;
+      return rpilcd_enqueue_one(filp, &req);
+    default:
+      return -ENOTTY;
+  }
+}
+
+/*===============================================================================================*/
+/*
+ * Mmap method, maps the struct rpilcd_map page of the panel. Only
+ * MAP_SHARED: a private mapping would copy the page on the first store and
+ * the driver would never see the cells.
+ */
+int rpilcd_mmap(struct file *filp, struct vm_area_struct *vma) {
+  struct rpilcd_dev_t * const pst_rpilcd = filp->private_data;
+
+  if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start > PAGE_SIZE) {
+    return -EINVAL;
+  }
+  if (!(vma->vm_flags & VM_SHARED)) {
+    return -EINVAL;
+  }
+  if (READ_ONCE(pst_rpilcd->b_gone)) {
+    return -ENODEV;
+  }
+  vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+  return vm_insert_page(vma, vma->vm_start, virt_to_page(pst_rpilcd->pst_map));
+}
+
+/*===============================================================================================*/
+/*
+ * Poll method: readable when the glass changed since the last read from
+ * offset 0, writable while the queue has room, hung up once unbound
+ */
+unsigned int rpilcd_poll(struct file *filp, poll_table *wait) {
+  struct rpilcd_dev_t * const pst_rpilcd = filp->private_data;
+  unsigned int mask = 0;
+
+  poll_wait(filp, &pst_rpilcd->readWait, wait);
+  poll_wait(filp, &pst_rpilcd->reqWait, wait);
+
+  spin_lock(&pst_rpilcd->snapLock);
+  if (pst_rpilcd->snapSeq != (unsigned int)filp->f_version) {
+    mask |= POLLIN | POLLRDNORM;
+  }
+  spin_unlock(&pst_rpilcd->snapLock);
+  if (READ_ONCE(pst_rpilcd->b_gone)) {
+    mask |= POLLHUP | POLLERR;
+  }
+  else if (!rpilcd_queue_full(pst_rpilcd)) {
+    mask |= POLLOUT | POLLWRNORM;
+  }
+  return mask;
+}
+
+/*===============================================================================================*/
+/*
+ * Fsync method, also called by msync(MS_SYNC) on the mapped buffer. Draws
+ * the dirty cells of the map and waits until everything written so far
+ * is on the glass.
+ */
+int rpilcd_fsync(struct file *filp, loff_t start, loff_t end, int datasync) {
+  struct rpilcd_dev_t * const pst_rpilcd = filp->private_data;
+  struct rpilcd_req_t req;
+  unsigned int seq;
+  int i32_ret = 0;
+  int row = 0;
+
+  for (row = 0; row < pst_rpilcd->core.rows; row++) {
+    if (READ_ONCE(pst_rpilcd->pst_map->dirty[row]) != 0) {
+      req.type = REQ_MAP;
+      req.count = 0;
+      i32_ret = rpilcd_enqueue_one(filp, &req);
+      if (i32_ret != 0) {
+        return i32_ret;
+      }
+      break;
+    }
+  }
+
+  rpilcd_lock_req(pst_rpilcd);
+  seq = pst_rpilcd->reqTail;
+  spin_unlock(&pst_rpilcd->reqLock);
+
+  if (wait_event_interruptible(pst_rpilcd->reqWait, rpilcd_drawn(pst_rpilcd, seq) ||
+                               READ_ONCE(pst_rpilcd->b_gone))) {
+    return -ERESTARTSYS;
+  }
+  return 0;
+}
+
+/*===============================================================================================*/
+/*
+ * sysfs attributes: lock_contended, bus_contended and queue_waits, how
+ * often a writer or the worker found a lock held or the queue full
+ */
+static ssize_t lock_contended_show(struct device *dev, struct device_attribute *attr, char *buf) {
+  const struct rpilcd_dev_t * const pst_rpilcd = dev_get_drvdata(dev);
+  return sprintf(buf, "%u\n", READ_ONCE(pst_rpilcd->lockContended));
+}
+
+static ssize_t bus_contended_show(struct device *dev, struct device_attribute *attr, char *buf) {
+  const struct rpilcd_dev_t * const pst_rpilcd = dev_get_drvdata(dev);
+  return sprintf(buf, "%u\n", READ_ONCE(pst_rpilcd->busContended));
+}
+
+static ssize_t queue_waits_show(struct device *dev, struct device_attribute *attr, char *buf) {
+  const struct rpilcd_dev_t * const pst_rpilcd = dev_get_drvdata(dev);
+  return sprintf(buf, "%u\n", READ_ONCE(pst_rpilcd->queueWaits));
+}
+
+static DEVICE_ATTR_RO(lock_contended);
+static DEVICE_ATTR_RO(bus_contended);
+static DEVICE_ATTR_RO(queue_waits);
+
+static struct attribute *rpilcd_attrs[] = {
+  &dev_attr_lock_contended.attr,
+  &dev_attr_bus_contended.attr,
+  &dev_attr_queue_waits.attr,
+  NULL,
+};
+ATTRIBUTE_GROUPS(rpilcd);
+
+/*===============================================================================================*/
+/*
+ * debugfs counters of a panel. latency_hist shows the queue to glass
+ * latency of the requests, one line per power of two milliseconds.
+ */
+static int rpilcd_latency_show(struct seq_file *m, void *v) {
+  const struct rpilcd_dev_t * const pst_rpilcd = m->private;
+  int bucket = 0;
+
+  for (bucket = 0; bucket < LATENCY_BUCKETS - 1; bucket++) {
+    seq_printf(m, "< %4lld ms: %u\n", 1LL << bucket, READ_ONCE(pst_rpilcd->latencyHist[bucket]));
+  }
+  seq_printf(m, ">= %3lld ms: %u\n", 1LL << bucket, READ_ONCE(pst_rpilcd->latencyHist[bucket]));
+  return 0;
+}
+
+static int rpilcd_latency_open(struct inode *inode, struct file *file) {
+  return single_open(file, rpilcd_latency_show, inode->i_private);
+}
+
+static const struct file_operations rpilcd_latency_fops = {
+  .owner      = THIS_MODULE,
+  .open       = rpilcd_latency_open,
+  .read       = seq_read,
+  .llseek     = seq_lseek,
+  .release    = single_release,
+};
+
+static void rpilcd_debugfs_init(struct rpilcd_dev_t * const pst_rpilcd) {
+  char sz_name[16];
+  struct dentry *dir;
+
+  snprintf(sz_name, sizeof(sz_name), DEVICE_NAME "%d", pst_rpilcd->i32_minor);
+  dir = debugfs_create_dir(sz_name, gpst_rpilcd_debugfs);
+  if (IS_ERR_OR_NULL(dir)) {
+    return;
+  }
+  pst_rpilcd->pst_debugfs = dir;
+  debugfs_create_u32("writes", S_IRUGO, dir, &pst_rpilcd->writes);
+  debugfs_create_u32("flushes", S_IRUGO, dir, &pst_rpilcd->flushes);
+  debugfs_create_u32("coalesced", S_IRUGO, dir, &pst_rpilcd->coalesced);
+  debugfs_create_u32("bus_bytes", S_IRUGO, dir, &pst_rpilcd->core.busBytes);
+  debugfs_create_u32("cmd_nibbles", S_IRUGO, dir, &pst_rpilcd->cmdNibbles);
+  debugfs_create_u32("data_nibbles", S_IRUGO, dir, &pst_rpilcd->dataNibbles);
+  debugfs_create_u64("delay_us", S_IRUGO, dir, &pst_rpilcd->delayUs);
+  debugfs_create_u32("timer_callbacks", S_IRUGO, dir, &pst_rpilcd->timerCallbacks);
+  debugfs_create_u32("glyph_hits", S_IRUGO, dir, &pst_rpilcd->core.glyphHits);
+  debugfs_create_u32("glyph_uploads", S_IRUGO, dir, &pst_rpilcd->core.glyphUploads);
+  debugfs_create_u32("glyph_misses", S_IRUGO, dir, &pst_rpilcd->core.glyphMisses);
+  debugfs_create_u32("marquee_steps", S_IRUGO, dir, &pst_rpilcd->core.marqueeSteps);
+  debugfs_create_file("latency_hist", S_IRUGO, dir, pst_rpilcd, &rpilcd_latency_fops);
+  if (pst_rpilcd->pst_client != NULL) {
+    debugfs_create_u32("i2c_transfers", S_IRUGO, dir, &pst_rpilcd->pcf.transfers);
+    debugfs_create_u32("i2c_bytes", S_IRUGO, dir, &pst_rpilcd->pcf.bytes);
+    debugfs_create_u32("i2c_errors", S_IRUGO, dir, &pst_rpilcd->pcf.errors);
+  }
+}
+
+/*===============================================================================================*/
+/*
+ * Forget a panel for open(), the files already open keep their reference
+ */
+static void rpilcd_unpublish(struct rpilcd_dev_t * const pst_rpilcd) {
+  mutex_lock(&gst_rpilcd_lock);
+  apst_rpilcd[pst_rpilcd->i32_minor] = (struct rpilcd_dev_t *)NULL;
+  mutex_unlock(&gst_rpilcd_lock);
+}
+
+/*===============================================================================================*/
+/*
+ * Bring up one panel whose transport is set: model, worker, then
+ * /dev/rpilcdN. The caller frees pst_rpilcd on failure.
+ */
+static int rpilcd_setup(struct rpilcd_dev_t * const pst_rpilcd, struct device *dev,
+                        const int i32_rows, const int i32_cols) {
+  struct device * pst_device = (struct device *)NULL;
+  int i32_ret = 0;
+
+  pst_rpilcd->i32_minor = ida_simple_get(&rpilcd_ida, 0, RPILCD_MAX_DEVICES, GFP_KERNEL);
+  if(pst_rpilcd->i32_minor < 0) {
+    return pst_rpilcd->i32_minor;
+  }
+
+  rpilcd_core_init(&pst_rpilcd->core, i32_rows, i32_cols, &rpilcd_bus, pst_rpilcd);
+  kref_init(&pst_rpilcd->st_ref);
+  spin_lock_init(&pst_rpilcd->reqLock);
+  mutex_init(&pst_rpilcd->busLock);
+  mutex_init(&pst_rpilcd->writeLock);
+  spin_lock_init(&pst_rpilcd->snapLock);
+  init_waitqueue_head(&pst_rpilcd->readWait);
+  init_waitqueue_head(&pst_rpilcd->reqWait);
+  INIT_WORK(&pst_rpilcd->st_work, rpilcd_work_fn);
+  INIT_DELAYED_WORK(&pst_rpilcd->st_marquee, rpilcd_marquee_fn);
+  init_completion(&pst_rpilcd->st_txDone);
+  hrtimer_init(&pst_rpilcd->st_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+  pst_rpilcd->st_timer.function = rpilcd_tx_timer;
+
+  pst_rpilcd->pst_map = (struct rpilcd_map *)get_zeroed_page(GFP_KERNEL);
+  if (pst_rpilcd->pst_map == (struct rpilcd_map *)NULL) {
+    printk(KERN_ALERT "[RPILCD] map allocation failed\n" );
+    ida_simple_remove(&rpilcd_ida, pst_rpilcd->i32_minor);
+    return -ENOMEM;
+  }
+  pst_rpilcd->pst_map->rows = i32_rows;
+  pst_rpilcd->pst_map->cols = i32_cols;
+  memset(pst_rpilcd->pst_map->cells, ' ', sizeof(pst_rpilcd->pst_map->cells));
+
+  // worker drawing queued writes
+  pst_rpilcd->wq = alloc_ordered_workqueue("rpilcd%d", 0, pst_rpilcd->i32_minor);
+  if(pst_rpilcd->wq == (struct workqueue_struct *)NULL) {
+    printk(KERN_WARNING "[RPILCD] Error creating workqueue\n");
+    free_page((unsigned long)pst_rpilcd->pst_map);
+    ida_simple_remove(&rpilcd_ida, pst_rpilcd->i32_minor);
+    return -ENOMEM;
+  }
+
+  // init lcd screen
+  rpilcd_lock_bus(pst_rpilcd);
+  rpilcd_init_display(pst_rpilcd);
+  rpilcd_clear_display(pst_rpilcd);
+  rpilcd_set_cursor(pst_rpilcd, 1, 1);
+  rpilcd_transport_flush(pst_rpilcd);
+  rpilcd_core_reset_shadow(&pst_rpilcd->core);
+  mutex_unlock(&pst_rpilcd->busLock);
+  rpilcd_publish(pst_rpilcd);
+
+  /* allocated apart, open files keep it after cdev_del() */
+  pst_rpilcd->pst_cdev = cdev_alloc();
+  if (pst_rpilcd->pst_cdev == (struct cdev *)NULL) {
+    printk(KERN_ALERT "[RPILCD] cdev allocation failed\n" );
+    destroy_workqueue(pst_rpilcd->wq);
+    free_page((unsigned long)pst_rpilcd->pst_map);
+    ida_simple_remove(&rpilcd_ida, pst_rpilcd->i32_minor);
+    return -ENOMEM;
+  }
+  pst_rpilcd->pst_cdev->ops = &rpilcd_fops;
+  pst_rpilcd->pst_cdev->owner = THIS_MODULE;
+
+  i32_ret = cdev_add(pst_rpilcd->pst_cdev, MKDEV(MAJOR(gst_dev), pst_rpilcd->i32_minor), 1);
+  if (i32_ret != 0) {
+    printk(KERN_ALERT "[RPILCD] device addition failed\n" );
+    kobject_put(&pst_rpilcd->pst_cdev->kobj);
+    destroy_workqueue(pst_rpilcd->wq);
+    free_page((unsigned long)pst_rpilcd->pst_map);
+    ida_simple_remove(&rpilcd_ida, pst_rpilcd->i32_minor);
+    return i32_ret;
+  }
+
+  pst_device = device_create_with_groups(gpst_rpilcd_class, dev,
+                                         MKDEV(MAJOR(gst_dev), pst_rpilcd->i32_minor), pst_rpilcd,
+                                         rpilcd_groups, DEVICE_NAME "%d", pst_rpilcd->i32_minor);
+  if (IS_ERR_OR_NULL(pst_device)) {
+    printk(KERN_ALERT "[RPILCD] device creation failed\n" );
+    cdev_del(pst_rpilcd->pst_cdev);
+    destroy_workqueue(pst_rpilcd->wq);
+    free_page((unsigned long)pst_rpilcd->pst_map);
+    ida_simple_remove(&rpilcd_ida, pst_rpilcd->i32_minor);
+    return -ENODEV;
+  }
+
+  rpilcd_debugfs_init(pst_rpilcd);
+  mutex_lock(&gst_rpilcd_lock);
+  apst_rpilcd[pst_rpilcd->i32_minor] = pst_rpilcd;
+  mutex_unlock(&gst_rpilcd_lock);
+  printk(KERN_INFO "[RPILCD] rpilcd%d: %dx%d panel, %s, %d bit bus%s\n", pst_rpilcd->i32_minor,
+         i32_cols, i32_rows, pst_rpilcd->pst_transport->name, pst_rpilcd->i32_width,
+         pst_rpilcd->b_busyflag ? ", busy flag" : "");
+  return 0;
+}
+
+/*===============================================================================================*/
+/*
+ * Take one panel down, what is still queued is drawn first. Files still
+ * open get -ENODEV, the panel is freed with the last of them.
+ */
+static void rpilcd_teardown(struct rpilcd_dev_t * const pst_rpilcd) {
+  rpilcd_unpublish(pst_rpilcd);
+  mutex_lock(&pst_rpilcd->writeLock);
+  pst_rpilcd->b_gone = true;
+  mutex_unlock(&pst_rpilcd->writeLock);
+
+  debugfs_remove_recursive(pst_rpilcd->pst_debugfs);
+  device_destroy(gpst_rpilcd_class, MKDEV(MAJOR(gst_dev), pst_rpilcd->i32_minor));
+  cdev_del(pst_rpilcd->pst_cdev);
+  flush_workqueue(pst_rpilcd->wq);
+  cancel_delayed_work_sync(&pst_rpilcd->st_marquee);
+  destroy_workqueue(pst_rpilcd->wq);
+  hrtimer_cancel(&pst_rpilcd->st_timer);
+  ida_simple_remove(&rpilcd_ida, pst_rpilcd->i32_minor);
+  wake_up_interruptible(&pst_rpilcd->reqWait);
+  wake_up_interruptible(&pst_rpilcd->readWait);
+  kref_put(&pst_rpilcd->st_ref, rpilcd_free);
+}
+
+/*===============================================================================================*/
+/*
+ * Panel on GPIO lines, from Device Tree or module parameters
+ */
+static int rpilcd_probe(struct platform_device *pdev) {
+  struct rpilcd_dev_t * pst_rpilcd = (struct rpilcd_dev_t *)NULL;
+  int i32_rows = 0;
+  int i32_cols = 0;
+  int i32_ret = 0;
+
+  /* not devm: open files may hold it after the unbind */
+  pst_rpilcd = kzalloc(sizeof(*pst_rpilcd), GFP_KERNEL);
+  if(pst_rpilcd == (struct rpilcd_dev_t *)NULL) {
+    return -ENOMEM;
+  }
+
+  i32_ret = rpilcd_lookup_gpios(pst_rpilcd, &pdev->dev, &i32_rows, &i32_cols);
+  if(i32_ret != 0) {
+    printk(KERN_WARNING "[RPILCD] Error request gpios of %s: %d\n", pdev->name, i32_ret);
+    kfree(pst_rpilcd);
+    return i32_ret;
+  }
+  pst_rpilcd->pst_transport = &rpilcd_gpio_transport;
+
+  i32_ret = rpilcd_setup(pst_rpilcd, &pdev->dev, i32_rows, i32_cols);
+  if(i32_ret != 0) {
+    kfree(pst_rpilcd);
+    return i32_ret;
+  }
+  platform_set_drvdata(pdev, pst_rpilcd);
+  return 0;
+}
+
+static int rpilcd_remove(struct platform_device *pdev) {
+  rpilcd_teardown(platform_get_drvdata(pdev));
+  return 0;
+}
+
+static const struct of_device_id rpilcd_of_match[] = {
+  { .compatible = "rpi,rpilcd" },
+  { }
+};
+MODULE_DEVICE_TABLE(of, rpilcd_of_match);
+
+static struct platform_driver rpilcd_driver = {
+  .probe      = rpilcd_probe,
+  .remove     = rpilcd_remove,
+  .driver     = {
+    .name           = DEVICE_NAME,
+    .of_match_table = rpilcd_of_match,
+  },
+};
+
+/*===============================================================================================*/
+/*
+ * Panel on a PCF8574 backpack. Without Device Tree it is created from
+ * userspace, the name giving the geometry:
+ *   echo rpilcd-pcf8574 0x27 > /sys/bus/i2c/devices/i2c-1/new_device
+ * and the same on i2c-stub (modprobe i2c-stub chip_addr=0x27) to try the
+ * driver without a panel.
+ */
+#define RPILCD_I2C_GEOMETRY(rows, cols)   (((rows) << 8) | (cols))
+
+static int rpilcd_i2c_probe(struct i2c_client *client, const struct i2c_device_id *id) {
+  struct rpilcd_dev_t * pst_rpilcd = (struct rpilcd_dev_t *)NULL;
+  u32 ui32_rows = 2;
+  u32 ui32_cols = 16;
+  int i32_ret = 0;
+
+  if(id != NULL) {
+    ui32_rows = id->driver_data >> 8;
+    ui32_cols = id->driver_data & 0xFF;
+  }
+  device_property_read_u32(&client->dev, "display-height-chars", &ui32_rows);
+  device_property_read_u32(&client->dev, "display-width-chars", &ui32_cols);
+  if(ui32_rows < 1 || ui32_rows > MAX_ROWS || ui32_cols < 1 || ui32_cols > MAX_LEN) {
+    printk(KERN_WARNING "[RPILCD] unsupported geometry %ux%u\n", ui32_cols, ui32_rows);
+    return -EINVAL;
+  }
+  /* rpilcd_i2c_xfer() falls back to single byte writes at worst */
+  if(!i2c_check_functionality(client->adapter, I2C_FUNC_I2C) &&
+     !i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_WRITE_BYTE)) {
+    return -EOPNOTSUPP;
+  }
+
+  /* not devm, see rpilcd_probe() */
+  pst_rpilcd = kzalloc(sizeof(*pst_rpilcd), GFP_KERNEL);
+  if(pst_rpilcd == (struct rpilcd_dev_t *)NULL) {
+    return -ENOMEM;
+  }
+  pst_rpilcd->pst_client = client;
+  pst_rpilcd->pst_transport = &rpilcd_i2c_transport;
+  pst_rpilcd->i32_width = 4;
+  rpilcd_pcf8574_init(&pst_rpilcd->pcf, PCF8574_BATCH, rpilcd_i2c_xfer, pst_rpilcd);
+
+  i32_ret = rpilcd_setup(pst_rpilcd, &client->dev, ui32_rows, ui32_cols);
+  if(i32_ret != 0) {
+    kfree(pst_rpilcd);
+    return i32_ret;
+  }
+  i2c_set_clientdata(client, pst_rpilcd);
+  return 0;
+}
+
+static int rpilcd_i2c_remove(struct i2c_client *client) {
+  rpilcd_teardown(i2c_get_clientdata(client));
+  return 0;
+}
+
+static const struct i2c_device_id rpilcd_i2c_id[] = {
+  { "rpilcd-pcf8574", RPILCD_I2C_GEOMETRY(2, 16) },
+  { "rpilcd-pcf8574-2004", RPILCD_I2C_GEOMETRY(4, 20) },
+  { }
+};
+MODULE_DEVICE_TABLE(i2c, rpilcd_i2c_id);
+
+static const struct of_device_id rpilcd_i2c_of_match[] = {
+  { .compatible = "rpi,rpilcd-pcf8574" },
+  { }
+};
+MODULE_DEVICE_TABLE(of, rpilcd_i2c_of_match);
+
+static struct i2c_driver rpilcd_i2c_driver = {
+  .probe      = rpilcd_i2c_probe,
+  .remove     = rpilcd_i2c_remove,
+  .id_table   = rpilcd_i2c_id,
+  .driver     = {
+    .name           = "rpilcd-pcf8574",
+    .of_match_table = rpilcd_i2c_of_match,
+  },
+};
+
+/*===============================================================================================*/
+/*
+ * Create the panels described by module parameters
+ */
+static void rpilcd_add_param_panels(void) {
+  struct rpilcd_pins_t st_pins;
+  int i32_data = 0;
+  int i32_idx = 0;
+
+  for(i32_idx = 0; i32_idx < panels && i32_idx < RPILCD_MAX_DEVICES; i32_idx++) {
+    st_pins.rs = rs[i32_idx];
+    st_pins.en = en[i32_idx];
+    st_pins.rw = rw[i32_idx];
+    st_pins.width = buswidth[i32_idx];
+    if(st_pins.width != 4 && st_pins.width != 8) {
+      printk(KERN_WARNING "[RPILCD] panel %d: buswidth %d, must be 4 or 8\n", i32_idx,
+             st_pins.width);
+      continue;
+    }
+    /* the data lines of the panels follow each other in data[] */
+    if(i32_data + st_pins.width > ARRAY_SIZE(data)) {
+      printk(KERN_WARNING "[RPILCD] panel %d: not enough data GPIOs\n", i32_idx);
+      continue;
+    }
+    memcpy(st_pins.data, &data[i32_data], st_pins.width * sizeof(st_pins.data[0]));
+    i32_data += st_pins.width;
+    st_pins.rows = rows[i32_idx];
+    st_pins.cols = cols[i32_idx];
+    if(st_pins.rs < 0 || st_pins.en < 0) {
+      printk(KERN_WARNING "[RPILCD] panel %d: rs and en not given\n", i32_idx);
+      continue;
+    }
+    apst_pdev[i32_idx] = platform_device_register_data(NULL, DEVICE_NAME, i32_idx,
+                                                       &st_pins, sizeof(st_pins));
+    if(IS_ERR(apst_pdev[i32_idx])) {
+      printk(KERN_WARNING "[RPILCD] panel %d: platform device creation failed\n", i32_idx);
+      apst_pdev[i32_idx] = (struct platform_device *)NULL;
+    }
+  }
+}
+
+/*===============================================================================================*/
 /*
  * Initialize the driver.
  */
 int __init rpilcd_register_device(void) {
-  int i32_ret = -1;
   int result = 0;
 
   printk(KERN_NOTICE "[RPILCD] init_rpilcd is called." );
 
-  result = alloc_chrdev_region(&gst_dev, 0, 1, DEVICE_NAME);
+  result = alloc_chrdev_region(&gst_dev, 0, RPILCD_MAX_DEVICES, DEVICE_NAME);
 
   if (0 > result) {
     printk(KERN_ALERT "[RPILCD] device registration failed\n" );
@@ -529,55 +2064,33 @@ int __init rpilcd_register_device(void) {
 
   if ((gpst_rpilcd_class = class_create(THIS_MODULE, CLASS_NAME) ) == NULL) {
     printk(KERN_ALERT "[RPILCD] class creation failed\n" );
-    unregister_chrdev_region(gst_dev, 1);
+    unregister_chrdev_region(gst_dev, RPILCD_MAX_DEVICES);
     return -1;
   }
 
-  if (device_create(gpst_rpilcd_class, NULL, gst_dev, NULL, DEVICE_NAME) == NULL) {
-    printk(KERN_ALERT "[RPILCD] device creation failed\n" );
-    class_destroy(gpst_rpilcd_class);
-    unregister_chrdev_region(gst_dev, 1 );
-    return -1;
-  }
-
-  cdev_init(&c_dev, &rpilcd_fops);
+  /* counters are optional, the driver works without debugfs */
+  gpst_rpilcd_debugfs = debugfs_create_dir(DEVICE_NAME, NULL);
 
-  if (cdev_add(&c_dev, gst_dev, 1 ) == -1) {
-    printk(KERN_ALERT "[RPILCD] device addition failed\n" );
-    device_destroy(gpst_rpilcd_class, gst_dev);
+  result = platform_driver_register(&rpilcd_driver);
+  if (result != 0) {
+    printk(KERN_ALERT "[RPILCD] driver registration failed\n" );
+    debugfs_remove_recursive(gpst_rpilcd_debugfs);
     class_destroy(gpst_rpilcd_class);
-    unregister_chrdev_region(gst_dev, 1 );
-    return -1;
-  }
-
-  //---- INIT WITHOUT DEVICE CREATION
-  /* allocate a private structure and reference it as driver’s data */
-  /*pst_rpilcd = (struct rpilcd_dev_t *)kmalloc(sizeof(struct rpilcd_dev_t), GFP_KERNEL);
-  if(pst_rpilcd == (struct rpilcd_dev_t *)NULL) {
-          printk(KERN_WARNING "[RPILCD] error mem struct\n");
-          return -1;
+    unregister_chrdev_region(gst_dev, RPILCD_MAX_DEVICES);
+    return result;
   }
 
-  result = register_chrdev( 0, DEVICE_NAME, &rpilcd_fops );
-  if( result < 0 )
-  {
-    printk( KERN_WARNING "[RPILCD]:  can\'t register character device with errorcode = %i", result );
+  result = i2c_add_driver(&rpilcd_i2c_driver);
+  if (result != 0) {
+    printk(KERN_ALERT "[RPILCD] i2c driver registration failed\n" );
+    platform_driver_unregister(&rpilcd_driver);
+    debugfs_remove_recursive(gpst_rpilcd_debugfs);
+    class_destroy(gpst_rpilcd_class);
+    unregister_chrdev_region(gst_dev, RPILCD_MAX_DEVICES);
     return result;
-  }*/
-  //----
-
-  // request multiple GPIOs
-  i32_ret = gpio_request_array(rpilcd_gpios, ARRAY_SIZE(rpilcd_gpios));
-  if(i32_ret != 0) {
-    printk(KERN_WARNING "[RPILCD] Error request multiple gpios\n");
-    device_destroy(gpst_rpilcd_class, gst_dev);
-    return -1;
   }
 
-  // init lcd screen
-  rpilcd_init_display();
-  rpilcd_clear_display();
-  rpilcd_set_cursor(1, 1);
+  rpilcd_add_param_panels();
 
   printk(KERN_ALERT "[RPILCD] LOADED\n");
 
@@ -589,13 +2102,19 @@ int __init rpilcd_register_device(void) {
  * Cleanup and unregister the driver.
  */
 void __exit rpilcd_unregister_device(void) {
-    /* release multiple GPIOs */
-    gpio_free_array(rpilcd_gpios, ARRAY_SIZE(rpilcd_gpios));
+    int i32_idx = 0;
+
+    for(i32_idx = 0; i32_idx < RPILCD_MAX_DEVICES; i32_idx++) {
+      if(apst_pdev[i32_idx] != NULL) {
+        platform_device_unregister(apst_pdev[i32_idx]);
+      }
+    }
+    i2c_del_driver(&rpilcd_i2c_driver);
+    platform_driver_unregister(&rpilcd_driver);
+    debugfs_remove_recursive(gpst_rpilcd_debugfs);
 
-    cdev_del(&c_dev);
-    device_destroy(gpst_rpilcd_class, gst_dev);
     class_destroy(gpst_rpilcd_class);
-    kfree(pst_rpilcd);
+    ida_destroy(&rpilcd_ida);
     /* unregistred driver from the kernel */
-    unregister_chrdev_region(gst_dev, 1);
+    unregister_chrdev_region(gst_dev, RPILCD_MAX_DEVICES);
 }
@@ -0,0 +1,62 @@
+// Client side of rpilcd_compd, see rpilcd_comp.h.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "rpilcd_comp.h"
+
+// connects to the daemon, returns the socket or -1 with errno set
+int rpilcd_comp_connect(const char *path) {
+  struct sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int rpilcd_comp_send(int fd, const struct rpilcd_comp_msg *msg) {
+  return send(fd, msg, sizeof(*msg), MSG_NOSIGNAL) == sizeof(*msg) ? 0 : -1;
+}
+
+// sets region id to rows lines of text, each padded with spaces to cols
+int rpilcd_comp_put(int fd, int id, int row, int col, int rows, int cols, int priority,
+                    uint32_t timeout_ms, const char *const *lines) {
+  struct rpilcd_comp_msg msg;
+  int r;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.op = RPILCD_COMP_PUT;
+  msg.id = id;
+  msg.row = row;
+  msg.col = col;
+  msg.rows = rows;
+  msg.cols = cols;
+  msg.priority = priority;
+  msg.timeout_ms = timeout_ms;
+  for (r = 0; r < rows && r < RPILCD_MAX_ROWS; r++) {
+    const char *line = lines[r] != NULL ? lines[r] : "";
+    const size_t len = strnlen(line, RPILCD_MAX_COLS);
+    memset(msg.cells[r], ' ', RPILCD_MAX_COLS);
+    memcpy(msg.cells[r], line, len);
+  }
+  return rpilcd_comp_send(fd, &msg);
+}
+
+int rpilcd_comp_remove(int fd, int id) {
+  struct rpilcd_comp_msg msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.op = RPILCD_COMP_REMOVE;
+  msg.id = id;
+  return rpilcd_comp_send(fd, &msg);
+}
@@ -0,0 +1,47 @@
+#ifndef RPILCD_COMP_H_
+#define RPILCD_COMP_H_
+/*
+ * Protocol of rpilcd_compd, the compositor owning /dev/rpilcdN, and the
+ * client side of it in rpilcd_comp.c. Userspace only.
+ */
+#include <stdint.h>
+
+#include "rpilcd_ioctl.h"
+
+#define RPILCD_COMP_SOCKET    "/run/rpilcd_compd.sock"
+
+/**
+ * A client owns up to RPILCD_COMP_REGIONS regions, rectangles of the
+ * panel starting from row=1 and column=1. Every message on the socket
+ * (SOCK_SEQPACKET, one struct per message) replaces or removes one
+ * region whole. The daemon draws the regions by priority, the newest on
+ * top of equal ones, over a blank panel; a cell holding '\0' shows what
+ * is below. A region with a timeout goes away that long after its last
+ * message, and all regions of a client when it disconnects. The panel is
+ * flushed at most once per refresh tick of the daemon, however many
+ * clients there are.
+ */
+#define RPILCD_COMP_REGIONS   4
+enum rpilcd_comp_op {
+  RPILCD_COMP_PUT = 1,
+  RPILCD_COMP_REMOVE = 2,
+};
+struct rpilcd_comp_msg {
+  uint8_t  op;
+  uint8_t  id;                            /* region of the client */
+  uint8_t  row;
+  uint8_t  col;
+  uint8_t  rows;
+  uint8_t  cols;
+  uint8_t  priority;                      /* higher is drawn over lower */
+  uint8_t  reserved;
+  uint32_t timeout_ms;                    /* 0 stays until removed */
+  char     cells[RPILCD_MAX_ROWS][RPILCD_MAX_COLS];
+};
+
+int rpilcd_comp_connect(const char *path);
+int rpilcd_comp_put(int fd, int id, int row, int col, int rows, int cols, int priority,
+                    uint32_t timeout_ms, const char *const *lines);
+int rpilcd_comp_remove(int fd, int id);
+
+#endif //RPILCD_COMP_H_
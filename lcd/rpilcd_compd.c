@@ -0,0 +1,442 @@
+// Compositor owning an rpilcd panel, shared by several clients.
+//
+// gcc -O2 -Wall -std=gnu99 -o rpilcd_compd rpilcd_compd.c
+// ./rpilcd_compd [-d /dev/rpilcd0] [-s socket] [-m mode] [-t tick ms]
+//
+// Clients connect to the Unix socket (RPILCD_COMP_SOCKET by default) and
+// send struct rpilcd_comp_msg, see rpilcd_comp.h. The regions are drawn
+// into one frame and the cells which changed go to the driver through
+// its mmap()ed buffer and RPILCD_IOC_FLUSH_MAP, at most once per tick
+// (100 ms by default): the bus carries at most one diff of the panel per
+// tick whatever the number of clients. SIGINT and SIGTERM stop it and
+// print the counters.
+//
+// The socket is created with mode 0660 (-m to change it), so only the
+// group of the daemon may draw: run it with the group of the clients.
+// It refuses to start while another daemon answers on the socket.
+
+#define _GNU_SOURCE             // accept4()
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include "rpilcd_comp.h"
+
+#define MAX_CLIENTS   16
+#define MAX_REGIONS   (MAX_CLIENTS * RPILCD_COMP_REGIONS)
+
+struct region {
+  int used;
+  int row, col, rows, cols;             // from 0, clipped to the panel
+  int priority;
+  uint64_t seq;                         // newest on top of equal priorities
+  int64_t expires_ms;                   // 0 never
+  char cells[RPILCD_MAX_ROWS][RPILCD_MAX_COLS];
+};
+
+// client i owns regions[i * RPILCD_COMP_REGIONS ...], its socket is in
+// fds[i + 1], fds[0] is the listening socket
+static struct pollfd fds[MAX_CLIENTS + 1];
+static struct region regions[MAX_REGIONS];
+static uint64_t region_seq = 0;
+
+static struct rpilcd_map *map = NULL;
+static char frame[RPILCD_MAX_ROWS][RPILCD_MAX_COLS];
+
+static unsigned long stat_msgs = 0;
+static unsigned long stat_flushes = 0;
+static unsigned long stat_cells = 0;
+static unsigned long stat_clients = 0;
+
+static volatile sig_atomic_t quit = 0;
+
+static void on_quit(int sig) {
+  (void)sig;
+  quit = 1;
+}
+
+static int64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// ---------------------------------------------------
+// CLIENTS
+// ---------------------------------------------------
+// removes the socket a previous daemon left, fails with EADDRINUSE when
+// one still answers on it and EEXIST when the path is not a socket
+static int remove_stale(const struct sockaddr_un *addr) {
+  struct stat st;
+  int fd;
+
+  if (lstat(addr->sun_path, &st) != 0) {
+    return errno == ENOENT ? 0 : -1;
+  }
+  if (!S_ISSOCK(st.st_mode)) {
+    errno = EEXIST;
+    return -1;
+  }
+  fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) == 0) {
+    close(fd);
+    errno = EADDRINUSE;
+    return -1;
+  }
+  close(fd);
+  if (errno != ECONNREFUSED) {
+    return -1;
+  }
+  return unlink(addr->sun_path);
+}
+
+static int listen_socket(const char *path, mode_t mode) {
+  struct sockaddr_un addr;
+  mode_t mask;
+  int fd, ret;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  if (remove_stale(&addr) != 0) {
+    return -1;
+  }
+  fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  // no wider than mode between bind() and chmod()
+  mask = umask(~mode & 0777);
+  ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+  umask(mask);
+  // connecting needs write access, only the owner and the group may draw
+  if (ret != 0 || chmod(path, mode) != 0 || listen(fd, MAX_CLIENTS) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void accept_client(void) {
+  int fd = accept4(fds[0].fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+  int i;
+  if (fd < 0) {
+    return;
+  }
+  for (i = 1; i <= MAX_CLIENTS; i++) {
+    if (fds[i].fd < 0) {
+      fds[i].fd = fd;
+      fds[i].events = POLLIN;
+      stat_clients++;
+      return;
+    }
+  }
+  printf("Too many clients, one refused\n");
+  close(fd);
+}
+
+// drops the client and its regions, returns 1 when some were shown
+static int drop_client(int client) {
+  int changed = 0;
+  int i;
+  close(fds[client + 1].fd);
+  fds[client + 1].fd = -1;
+  for (i = 0; i < RPILCD_COMP_REGIONS; i++) {
+    changed |= regions[client * RPILCD_COMP_REGIONS + i].used;
+    regions[client * RPILCD_COMP_REGIONS + i].used = 0;
+  }
+  return changed;
+}
+
+static int clip(int value, int lo, int hi) {
+  return value < lo ? lo : (value > hi ? hi : value);
+}
+
+// applies one message, returns 1 when the frame may have changed
+static int apply_msg(int client, const struct rpilcd_comp_msg *msg, int64_t now) {
+  struct region *r;
+  int row;
+
+  if (msg->id >= RPILCD_COMP_REGIONS) {
+    return 0;
+  }
+  r = &regions[client * RPILCD_COMP_REGIONS + msg->id];
+  if (msg->op == RPILCD_COMP_REMOVE) {
+    const int changed = r->used;
+    r->used = 0;
+    return changed;
+  }
+  if (msg->op != RPILCD_COMP_PUT) {
+    return 0;
+  }
+  r->row = clip(msg->row, 1, map->rows) - 1;
+  r->col = clip(msg->col, 1, map->cols) - 1;
+  r->rows = clip(msg->rows, 0, map->rows - r->row);
+  r->cols = clip(msg->cols, 0, map->cols - r->col);
+  r->priority = msg->priority;
+  r->expires_ms = msg->timeout_ms != 0 ? now + msg->timeout_ms : 0;
+  for (row = 0; row < r->rows; row++) {
+    memcpy(r->cells[row], msg->cells[row], r->cols);
+  }
+  // a new region goes on top of its equals, an updated one stays put
+  if (!r->used) {
+    r->seq = ++region_seq;
+  }
+  r->used = 1;
+  return 1;
+}
+
+// reads every message waiting on the socket of a client
+static int read_client(int client, int64_t now) {
+  struct rpilcd_comp_msg msg;
+  int changed = 0;
+  ssize_t n;
+
+  while ((n = recv(fds[client + 1].fd, &msg, sizeof(msg), 0)) != 0) {
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return changed;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    stat_msgs++;
+    if (n == sizeof(msg)) {
+      changed |= apply_msg(client, &msg, now);
+    }
+  }
+  // end of file or error: the client is gone
+  return drop_client(client) | changed;
+}
+
+// ---------------------------------------------------
+// COMPOSITING
+// ---------------------------------------------------
+
+// removes the regions whose time is up, returns the next expiry or 0
+static int64_t expire(int64_t now, int *changed) {
+  int64_t next = 0;
+  int i;
+  for (i = 0; i < MAX_REGIONS; i++) {
+    struct region *r = &regions[i];
+    if (!r->used || r->expires_ms == 0) {
+      continue;
+    }
+    if (r->expires_ms <= now) {
+      r->used = 0;
+      *changed = 1;
+    }
+    else if (next == 0 || r->expires_ms < next) {
+      next = r->expires_ms;
+    }
+  }
+  return next;
+}
+
+static int below(const struct region *a, const struct region *b) {
+  return a->priority < b->priority || (a->priority == b->priority && a->seq < b->seq);
+}
+
+// paints the regions bottom up over a blank panel into frame
+static void composite(void) {
+  const struct region *order[MAX_REGIONS];
+  int count = 0;
+  int i, j, row, col;
+
+  for (i = 0; i < MAX_REGIONS; i++) {
+    if (regions[i].used) {
+      // insertion sort, there are only a few
+      for (j = count; j > 0 && below(&regions[i], order[j - 1]); j--) {
+        order[j] = order[j - 1];
+      }
+      order[j] = &regions[i];
+      count++;
+    }
+  }
+  memset(frame, ' ', sizeof(frame));
+  for (i = 0; i < count; i++) {
+    const struct region *r = order[i];
+    for (row = 0; row < r->rows; row++) {
+      for (col = 0; col < r->cols; col++) {
+        if (r->cells[row][col] != '\0') {
+          frame[r->row + row][r->col + col] = r->cells[row][col];
+        }
+      }
+    }
+  }
+}
+
+// cells handed to the driver by a flush which failed
+static int unflushed = 0;
+
+// hands the cells which changed to the driver, one flush. Returns -1 when
+// the driver refused it, the next call flushes them again.
+static int flush_frame(int lcdfd) {
+  unsigned int changed = 0;
+  unsigned int row, col, mask;
+
+  composite();
+  for (row = 0; row < map->rows; row++) {
+    mask = 0;
+    for (col = 0; col < map->cols; col++) {
+      if (map->cells[row][col] != frame[row][col]) {
+        map->cells[row][col] = frame[row][col];
+        mask |= 1u << col;
+        changed++;
+      }
+    }
+    if (mask != 0) {
+      __atomic_fetch_or(&map->dirty[row], mask, __ATOMIC_RELEASE);
+    }
+  }
+  if (changed == 0 && !unflushed) {
+    return 0;
+  }
+  if (ioctl(lcdfd, RPILCD_IOC_FLUSH_MAP) != 0) {
+    // once, not every tick while it keeps failing
+    if (!unflushed) {
+      printf("Can't flush the lcd device: %s\n", strerror(errno));
+    }
+    unflushed = 1;
+    return -1;
+  }
+  unflushed = 0;
+  stat_flushes++;
+  stat_cells += changed;
+  return 0;
+}
+
+// ---------------------------------------------------
+// MAIN
+// ---------------------------------------------------
+int main(int argc, char *argv[]) {
+  const char *device = "/dev/rpilcd0";
+  const char *path = RPILCD_COMP_SOCKET;
+  int64_t tick = 100;
+  mode_t mode = 0660;
+  int64_t last_flush, next_expiry, now;
+  struct sigaction sa;
+  int dirty = 1;
+  int lcdfd, opt, i, timeout;
+
+  while ((opt = getopt(argc, argv, "d:s:m:t:")) != -1) {
+    switch (opt) {
+      case 'd':
+        device = optarg;
+        break;
+      case 's':
+        path = optarg;
+        break;
+      case 'm':
+        mode = strtoul(optarg, NULL, 8) & 0777;
+        break;
+      case 't':
+        tick = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-d device] [-s socket] [-m mode] [-t tick ms]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (tick < 1) {
+    fprintf(stderr, "tick must be positive\n");
+    return 1;
+  }
+
+  lcdfd = open(device, O_RDWR);
+  if (lcdfd < 0) {
+    perror(device);
+    return 1;
+  }
+  map = mmap(NULL, sizeof(*map), PROT_READ | PROT_WRITE, MAP_SHARED, lcdfd, 0);
+  if (map == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  fds[0].fd = listen_socket(path, mode);
+  fds[0].events = POLLIN;
+  if (fds[0].fd < 0) {
+    perror(path);
+    return 1;
+  }
+  for (i = 1; i <= MAX_CLIENTS; i++) {
+    fds[i].fd = -1;
+  }
+  // the buffer may hold what another process left, draw everything once
+  memset(map->cells, 0, sizeof(map->cells));
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_quit;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  printf("rpilcd_compd: %ux%u panel on %s, clients on %s, tick %d ms\n", map->cols, map->rows,
+         device, path, (int)tick);
+
+  last_flush = now_ms() - tick;
+  while (!quit) {
+    now = now_ms();
+    next_expiry = expire(now, &dirty);
+    if (dirty && now - last_flush >= tick) {
+      // on failure dirty stays set and the next tick tries again
+      if (flush_frame(lcdfd) == 0) {
+        dirty = 0;
+      }
+      last_flush = now;
+    }
+
+    // sleep until the next tick with something to draw, or the next expiry
+    timeout = -1;
+    if (dirty) {
+      timeout = (int)(last_flush + tick - now);
+    }
+    if (next_expiry != 0 && (timeout < 0 || next_expiry - now < timeout)) {
+      timeout = (int)(next_expiry - now);
+    }
+    if (poll(fds, MAX_CLIENTS + 1, timeout) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      break;
+    }
+    now = now_ms();
+    if (fds[0].revents & POLLIN) {
+      accept_client();
+    }
+    for (i = 1; i <= MAX_CLIENTS; i++) {
+      if (fds[i].fd >= 0 && (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+        dirty |= read_client(i - 1, now);
+      }
+    }
+  }
+
+  printf("rpilcd_compd: %lu clients, %lu messages, %lu flushes, %lu cells\n", stat_clients,
+         stat_msgs, stat_flushes, stat_cells);
+  for (i = 0; i <= MAX_CLIENTS; i++) {
+    if (fds[i].fd >= 0) {
+      close(fds[i].fd);
+    }
+  }
+  unlink(path);
+  munmap(map, sizeof(*map));
+  close(lcdfd);
+  return 0;
+}
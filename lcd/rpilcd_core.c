@@ -0,0 +1,792 @@
+#include "rpilcd_core.h"
+
+/*
+ * Text model of the display and frame diffing, shared by the kernel module
+ * and the host simulator in sim/. Nothing in here touches the hardware,
+ * bytes for the controller go through core->bus.
+ */
+
+#ifdef __KERNEL__
+#define RPILCD_LOG(...) pr_debug(__VA_ARGS__)
+#else
+#define RPILCD_LOG(...) do { } while (0)
+#endif
+
+/*===============================================================================================*/
+/*
+ * Initialise the model of a rows x cols panel, display and shadow are empty
+ */
+void rpilcd_core_init(struct rpilcd_core_t *core, const int rows, const int cols,
+                      const struct rpilcd_bus_t *bus, void *busCtx) {
+  memset(core, 0, sizeof(*core));
+  core->rows = (rows >= 1 && rows <= MAX_ROWS) ? rows : 2;
+  core->cols = (cols >= 1 && cols <= MAX_LEN) ? cols : 16;
+  core->curRow = 1;
+  core->curCol = 1;
+  core->savedRow = 1;
+  core->savedCol = 1;
+  core->bus = bus;
+  core->busCtx = busCtx;
+}
+
+static int rpilcd_clamp(const int value, const int lo, const int hi) {
+  if (value < lo) {
+    return lo;
+  }
+  if (value > hi) {
+    return hi;
+  }
+  return value;
+}
+
+/*
+ * Set DDRAM address command for a position starting from row=1, column=1.
+ * Lines 3 and 4 of a 4 line panel continue lines 1 and 2 in DDRAM.
+ */
+static unsigned char rpilcd_core_cursor_cmd(const struct rpilcd_core_t *core, const int row,
+                                            const int col) {
+  unsigned char cmd = 0x80;
+  switch (row) {
+    case 1:
+      cmd += col - 1;
+      break;
+    case 2:
+      cmd += 0x40 + (col - 1);
+      break;
+    case 3:
+      cmd += core->cols + (col - 1);
+      break;
+    case 4:
+      cmd += 0x40 + core->cols + (col - 1);
+      break;
+    default:
+      break;
+  }
+  return cmd;
+}
+
+/*
+ * Send one command (rs == 0) or character (rs == 1) to the controller
+ */
+static void rpilcd_core_send(struct rpilcd_core_t *core, const int rs, const unsigned char byte) {
+  core->busBytes++;
+  core->bus->write(core->busCtx, rs, byte);
+}
+
+/*===============================================================================================*/
+/*
+ * Reset the shadow after the display has been cleared
+ */
+void rpilcd_core_reset_shadow(struct rpilcd_core_t *core) {
+  memset(core->shadow, ' ', sizeof(core->shadow));
+  core->acRow = 1;
+  core->acCol = 1;
+}
+
+/*
+ * Move the cursor unless the address counter is already there
+ */
+static void rpilcd_core_goto(struct rpilcd_core_t *core, const int row, const int col) {
+  if (core->acRow != row || core->acCol != col) {
+    rpilcd_core_send(core, 0, rpilcd_core_cursor_cmd(core, row, col));
+    core->acRow = row;
+    core->acCol = col;
+  }
+}
+
+/*
+ * Expand a line buffer to cols cells, blank cells being spaces
+ */
+static void rpilcd_render_line(const char *line, char *cells, const int cols) {
+  int col = 0;
+  for (col = 0; col < cols && line[col] != '\0'; col++) {
+    cells[col] = line[col];
+  }
+  for (; col < cols; col++) {
+    cells[col] = ' ';
+  }
+}
+
+/*
+ * Send the glyphs waiting for their CGRAM slot, consecutive slots in one
+ * run. The address counter is then in CGRAM, so the next cell needs a set
+ * DDRAM address command.
+ */
+static void rpilcd_core_upload_glyphs(struct rpilcd_core_t *core) {
+  int next = -1;
+  int slot, i;
+
+  for (slot = 0; slot < CGRAM_SLOTS; slot++) {
+    if (!core->glyphs[slot].upload) {
+      continue;
+    }
+    if (next != slot) {
+      rpilcd_core_send(core, 0, 0x40 | (slot * GLYPH_ROWS));
+    }
+    for (i = 0; i < GLYPH_ROWS; i++) {
+      rpilcd_core_send(core, 1, core->glyphs[slot].bitmap[i]);
+    }
+    core->glyphs[slot].upload = false;
+    core->glyphUploads++;
+    core->acRow = 0;
+    next = slot + 1;
+  }
+}
+
+/*
+ * Shadow of the cells visible with the display shifted by the marquee
+ */
+static void rpilcd_core_marquee_shadow(struct rpilcd_core_t *core, const int shift) {
+  int row, col;
+  for (row = 0; row < core->rows; row++) {
+    for (col = 0; col < core->cols; col++) {
+      core->shadow[row][col] = core->marquee.text[row][(shift + col) % RPILCD_MARQUEE_LEN];
+    }
+  }
+}
+
+/*
+ * Load or take down the marquee. The 80 DDRAM cells are sent in one run:
+ * on 2 lines the address counter goes on from 0x27 to 0x40, a 1 line
+ * panel has a single line of 80 cells which gets the text twice, so it
+ * wraps after 40 cells as well.
+ */
+static void rpilcd_core_marquee_flush(struct rpilcd_core_t *core) {
+  struct rpilcd_marquee_t * const mq = &core->marquee;
+  int line, i;
+
+  if ((mq->load || mq->unload) && mq->shift != 0) {
+    /* return home, which also undoes the shift */
+    rpilcd_core_send(core, 0, 0x02);
+    mq->shift = 0;
+    core->acRow = 1;
+    core->acCol = 1;
+  }
+  if (mq->load) {
+    if (!mq->cursorOff) {
+      rpilcd_core_send(core, 0, 0x0C);
+      mq->cursorOff = true;
+    }
+    rpilcd_core_send(core, 0, 0x80);
+    for (line = 0; line < 2; line++) {
+      for (i = 0; i < RPILCD_MARQUEE_LEN; i++) {
+        rpilcd_core_send(core, 1, mq->text[core->rows > 1 ? line : 0][i]);
+      }
+    }
+    core->acRow = 0;
+    rpilcd_core_marquee_shadow(core, 0);
+    mq->load = false;
+  }
+  if (mq->unload) {
+    /* the first cols cells of the text are what DDRAM now shows */
+    rpilcd_core_marquee_shadow(core, 0);
+    if (mq->cursorOff) {
+      /* display on, cursor on, as rpilcd_init_display() leaves it */
+      rpilcd_core_send(core, 0, 0x0E);
+      mq->cursorOff = false;
+    }
+    mq->unload = false;
+  }
+}
+
+/*
+ * Send the cells of the lines which differ from the shadow and place the
+ * cursor. Returns the number of bytes sent to the controller.
+ */
+unsigned int rpilcd_core_flush(struct rpilcd_core_t *core) {
+  const unsigned int startBytes = core->busBytes;
+  char cells[MAX_LEN];
+  int row, col, end;
+
+  rpilcd_core_marquee_flush(core);
+  if (core->marquee.active) {
+    /* the lines wait behind the marquee */
+    return core->busBytes - startBytes;
+  }
+
+  /* before the cells showing them */
+  rpilcd_core_upload_glyphs(core);
+
+  for (row = 0; row < core->rows; row++) {
+    rpilcd_render_line(core->lines[row], cells, core->cols);
+    col = 0;
+    while (col < core->cols) {
+      if (cells[col] == core->shadow[row][col]) {
+        col++;
+        continue;
+      }
+      /* extend the run over single unchanged cells: resending one
+       * character is cheaper than a set cursor command */
+      end = col + 1;
+      while (end < core->cols) {
+        if (cells[end] != core->shadow[row][end]) {
+          end++;
+        }
+        else if (end + 1 < core->cols && cells[end+1] != core->shadow[row][end+1]) {
+          end += 2;
+        }
+        else {
+          break;
+        }
+      }
+      rpilcd_core_goto(core, row + 1, col + 1);
+      for (; col < end; col++) {
+        rpilcd_core_send(core, 1, cells[col]);
+        core->shadow[row][col] = cells[col];
+      }
+      core->acCol = end + 1;
+    }
+  }
+  rpilcd_core_goto(core, core->curRow, core->curCol);
+
+  return core->busBytes - startBytes;
+}
+
+/*
+ * Text of the shadow and the address counter for read(), in the format of
+ * RPILCD_SNAPSHOT_MAX. buf holds at least that many bytes, returns the
+ * length used. The cursor is where the last flush left it.
+ */
+size_t rpilcd_core_snapshot(const struct rpilcd_core_t *core, char *buf) {
+  size_t len = 0;
+  int row;
+
+  for (row = 0; row < core->rows; row++) {
+    memcpy(&buf[len], core->shadow[row], core->cols);
+    len += core->cols;
+    buf[len++] = '\n';
+  }
+  buf[len++] = '0' + (core->acRow / 10) % 10;
+  buf[len++] = '0' + core->acRow % 10;
+  buf[len++] = ' ';
+  buf[len++] = '0' + (core->acCol / 10) % 10;
+  buf[len++] = '0' + core->acCol % 10;
+  buf[len++] = '\n';
+  return len;
+}
+
+/*===============================================================================================*/
+/*
+ * Store a character in a cell, a line shorter than col is padded with
+ * spaces
+ */
+static void rpilcd_core_store(struct rpilcd_core_t *core, const int row, const int col,
+                              const char c) {
+  char *line = core->lines[row-1];
+  int len = strlen(line);
+
+  for (; len < col - 1; len++) {
+    line[len] = ' ';
+  }
+  line[col-1] = c;
+  if (col > len) {
+    line[col] = '\0';
+  }
+}
+
+/*
+ * Blank the cells first..last of a row, the end of a line is cut off
+ */
+static void rpilcd_core_erase(struct rpilcd_core_t *core, const int row, const int first,
+                              int last) {
+  char *line = core->lines[row-1];
+  const int len = strlen(line);
+  int col = 0;
+
+  if (last >= len) {
+    if (first <= len) {
+      line[first-1] = '\0';
+    }
+    last = first - 1;
+  }
+  for (col = first; col <= last; col++) {
+    line[col-1] = ' ';
+  }
+}
+
+static void rpilcd_core_clear(struct rpilcd_core_t *core) {
+  int row = 0;
+  for (row = 0; row < core->rows; row++) {
+    core->lines[row][0] = '\0';
+  }
+  rpilcd_core_set_cursor(core, 1, 1);
+}
+
+/*
+ * Printable character at the cursor. The cursor stays on the last column
+ * until the next character, which goes to the beginning of the next line,
+ * or is dropped on the last one.
+ */
+static void rpilcd_core_print(struct rpilcd_core_t *core, const char c) {
+  if (core->wrapPending) {
+    if (core->curRow == core->rows) {
+      return;
+    }
+    rpilcd_core_set_cursor(core, core->curRow + 1, 1);
+  }
+  rpilcd_core_store(core, core->curRow, core->curCol, c);
+  if (core->curCol < core->cols) {
+    core->curCol++;
+  }
+  else {
+    core->wrapPending = true;
+  }
+}
+
+/*
+ * Escapes of the old driver, which only knew them as a write() of their
+ * own: \n and \p move to the end of the text of the next and previous
+ * line, \r and \l one cell right and left, \d deletes the character
+ * under the cursor or the last one when the cursor is past the text, \c
+ * clears the display. \\ is a backslash.
+ */
+static void rpilcd_core_backslash(struct rpilcd_core_t *core, const char c) {
+  char *line = core->lines[core->curRow-1];
+  const int len = strlen(line);
+  int row = core->curRow;
+
+  switch (c) {
+    case 'n':
+    case 'p':
+      row += (c == 'n') ? 1 : -1;
+      if (row >= 1 && row <= core->rows) {
+        rpilcd_core_set_cursor(core, row, strlen(core->lines[row-1]) + 1);
+      }
+      break;
+    case 'r':
+      rpilcd_core_set_cursor(core, core->curRow, core->curCol + 1);
+      break;
+    case 'l':
+      rpilcd_core_set_cursor(core, core->curRow, core->curCol - 1);
+      break;
+    case 'd':
+      if (core->curCol > len) {
+        if (len > 0) {
+          line[len-1] = '\0';
+          rpilcd_core_set_cursor(core, core->curRow, len);
+        }
+      }
+      else {
+        memmove(line + core->curCol - 1, line + core->curCol, len - core->curCol + 1);
+      }
+      break;
+    case 'c':
+      rpilcd_core_clear(core);
+      break;
+    default:
+      rpilcd_core_print(core, '\\');
+      if (c != '\\') {
+        rpilcd_core_print(core, c);
+      }
+      break;
+  }
+}
+
+static int rpilcd_core_param(const struct rpilcd_parser_t *parser, const int i, const int def) {
+  return (parser->params[i] > 0) ? parser->params[i] : def;
+}
+
+/*
+ * Final byte of a CSI sequence: cursor movement (A, B, C, D, G, H, f),
+ * erase in display and in line (J, K), save and restore the cursor (s, u)
+ */
+static void rpilcd_core_csi(struct rpilcd_core_t *core, const char c) {
+  const struct rpilcd_parser_t *parser = &core->parser;
+  const int n = rpilcd_core_param(parser, 0, 1);
+  int row = 0;
+
+  switch (c) {
+    case 'A':
+      rpilcd_core_set_cursor(core, core->curRow - n, core->curCol);
+      break;
+    case 'B':
+      rpilcd_core_set_cursor(core, core->curRow + n, core->curCol);
+      break;
+    case 'C':
+      rpilcd_core_set_cursor(core, core->curRow, core->curCol + n);
+      break;
+    case 'D':
+      rpilcd_core_set_cursor(core, core->curRow, core->curCol - n);
+      break;
+    case 'G':
+      rpilcd_core_set_cursor(core, core->curRow, n);
+      break;
+    case 'H':
+    case 'f':
+      rpilcd_core_set_cursor(core, n, rpilcd_core_param(parser, 1, 1));
+      break;
+    case 'J':
+      /* the other lines here, the line of the cursor as for 'K' */
+      for (row = 1; row <= core->rows; row++) {
+        if ((parser->params[0] == 0 && row > core->curRow) ||
+            (parser->params[0] == 1 && row < core->curRow) || parser->params[0] >= 2) {
+          core->lines[row-1][0] = '\0';
+        }
+      }
+      /* fall through */
+    case 'K':
+      if (parser->params[0] == 0) {
+        rpilcd_core_erase(core, core->curRow, core->curCol, core->cols);
+      }
+      else if (parser->params[0] == 1) {
+        rpilcd_core_erase(core, core->curRow, 1, core->curCol);
+      }
+      else {
+        core->lines[core->curRow-1][0] = '\0';
+      }
+      break;
+    case 's':
+      core->savedRow = core->curRow;
+      core->savedCol = core->curCol;
+      break;
+    case 'u':
+      rpilcd_core_set_cursor(core, core->savedRow, core->savedCol);
+      break;
+    default:
+      break;
+  }
+}
+
+/*
+ * Feed one byte of a write() to the parser
+ */
+static void rpilcd_core_parse(struct rpilcd_core_t *core, const char c) {
+  struct rpilcd_parser_t *parser = &core->parser;
+
+  switch (parser->state) {
+    case PARSE_BACKSLASH:
+      parser->state = PARSE_TEXT;
+      rpilcd_core_backslash(core, c);
+      return;
+    case PARSE_ESC:
+      parser->state = PARSE_TEXT;
+      if (c == '[') {
+        memset(parser, 0, sizeof(*parser));
+        parser->state = PARSE_CSI;
+      }
+      else if (c == 'c') {
+        rpilcd_core_clear(core);
+        core->savedRow = 1;
+        core->savedCol = 1;
+      }
+      else if (c == '7') {
+        core->savedRow = core->curRow;
+        core->savedCol = core->curCol;
+      }
+      else if (c == '8') {
+        rpilcd_core_set_cursor(core, core->savedRow, core->savedCol);
+      }
+      return;
+    case PARSE_CSI:
+      if (c >= '0' && c <= '9') {
+        if (parser->param < PARSE_PARAMS) {
+          int *param = &parser->params[parser->param];
+          *param = *param * 10 + (c - '0');
+          if (*param > PARSE_MAX) {
+            *param = PARSE_MAX;
+          }
+        }
+      }
+      else if (c == ';') {
+        parser->param++;
+      }
+      else if (c == '?') {
+        parser->priv = true;
+      }
+      else if (c >= 0x40 && c <= 0x7E) {
+        parser->state = PARSE_TEXT;
+        if (!parser->priv) {
+          rpilcd_core_csi(core, c);
+        }
+      }
+      else if ((unsigned char)c < 0x20) {
+        /* malformed, the control character is taken as such */
+        parser->state = PARSE_TEXT;
+        rpilcd_core_parse(core, c);
+      }
+      return;
+    default:
+      break;
+  }
+
+  switch (c) {
+    case '\\':
+      parser->state = PARSE_BACKSLASH;
+      break;
+    case 0x1B:
+      parser->state = PARSE_ESC;
+      break;
+    case '\n':
+      if (core->curRow < core->rows) {
+        rpilcd_core_set_cursor(core, core->curRow + 1, 1);
+      }
+      else {
+        rpilcd_core_set_cursor(core, core->curRow, 1);
+      }
+      break;
+    case '\r':
+      rpilcd_core_set_cursor(core, core->curRow, 1);
+      break;
+    case '\b':
+      rpilcd_core_set_cursor(core, core->curRow, core->curCol - 1);
+      break;
+    case '\f':
+      rpilcd_core_clear(core);
+      break;
+    default:
+      /* other control characters, NUL included, are ignored */
+      if ((unsigned char)c >= 0x20) {
+        rpilcd_core_print(core, c);
+      }
+      break;
+  }
+}
+
+/*
+ * Apply count bytes of a write() to the lines and the cursor, see the
+ * grammar in rpilcd_ioctl.h. A sequence cut at the end continues with
+ * the next write.
+ */
+void rpilcd_core_apply_write(struct rpilcd_core_t *core, const char *buff, size_t count) {
+  size_t i = 0;
+
+  RPILCD_LOG("[RPILCD] write (%zu)\n", count);
+  for (i = 0; i < count; i++) {
+    rpilcd_core_parse(core, buff[i]);
+  }
+}
+
+/*
+ * Replace the first two lines and the cursor with the content of a frame
+ */
+void rpilcd_core_apply_frame(struct rpilcd_core_t *core, const struct rpilcd_frame *frame) {
+  const char *lines[RPILCD_ROWS] = { frame->line1, frame->line2 };
+  const int len = (core->cols < RPILCD_COLS) ? core->cols : RPILCD_COLS;
+  int row = 0;
+
+  for (row = 0; row < RPILCD_ROWS && row < core->rows; row++) {
+    memcpy(core->lines[row], lines[row], len);
+    core->lines[row][len] = '\0';
+  }
+  rpilcd_core_set_cursor(core, frame->row, frame->col);
+}
+
+/*
+ * Move the cursor, starting from row=1 and column=1
+ */
+void rpilcd_core_set_cursor(struct rpilcd_core_t *core, const int row, const int col) {
+  core->curRow = rpilcd_clamp(row, 1, core->rows);
+  core->curCol = rpilcd_clamp(col, 1, core->cols);
+  core->wrapPending = false;
+}
+
+/*
+ * Copy the cells of one row selected by mask (bit 0 is column 1) into the
+ * line, e.g. from the mmap()ed buffer. A line shorter than a changed
+ * column is padded with spaces, '\0' cells are stored as spaces.
+ */
+void rpilcd_core_apply_cells(struct rpilcd_core_t *core, const int row, const unsigned int mask,
+                             const char *cells) {
+  char *line = core->lines[row-1];
+  int len = strlen(line);
+  int col = 0;
+
+  for (col = 0; col < core->cols; col++) {
+    if ((mask & (1u << col)) == 0) {
+      continue;
+    }
+    for (; len < col; len++) {
+      line[len] = ' ';
+    }
+    line[col] = (cells[col] != '\0') ? cells[col] : ' ';
+    if (col >= len) {
+      len = col + 1;
+      line[len] = '\0';
+    }
+  }
+}
+
+/*===============================================================================================*/
+/*
+ * A slot can't be replaced while its code is on the glass or in the lines
+ * about to be drawn, the controller would change those cells too.
+ */
+static bool rpilcd_core_glyph_used(const struct rpilcd_core_t *core, const int slot) {
+  const char code = GLYPH_BASE + slot;
+  int row = 0;
+
+  for (row = 0; row < core->rows; row++) {
+    if (memchr(core->lines[row], code, strlen(core->lines[row])) != NULL) {
+      return true;
+    }
+  }
+  return memchr(core->shadow, code, sizeof(core->shadow)) != NULL;
+}
+
+/*
+ * Character code showing bitmap. A glyph already in CGRAM is reused,
+ * otherwise it takes a free slot or the least recently used one not on
+ * screen, and is uploaded by the next flush. Returns -1 when every slot
+ * is on screen.
+ */
+int rpilcd_core_glyph(struct rpilcd_core_t *core, const unsigned char *bitmap) {
+  unsigned char pixels[GLYPH_ROWS];
+  int victim = -1;
+  int slot, i;
+
+  for (i = 0; i < GLYPH_ROWS; i++) {
+    pixels[i] = bitmap[i] & 0x1F;
+  }
+  core->glyphClock++;
+
+  for (slot = 0; slot < CGRAM_SLOTS; slot++) {
+    if (core->glyphs[slot].valid && memcmp(core->glyphs[slot].bitmap, pixels, GLYPH_ROWS) == 0) {
+      core->glyphs[slot].lastUse = core->glyphClock;
+      core->glyphHits++;
+      return GLYPH_BASE + slot;
+    }
+  }
+
+  for (slot = 0; slot < CGRAM_SLOTS && victim < 0; slot++) {
+    if (!core->glyphs[slot].valid) {
+      victim = slot;
+    }
+  }
+  for (slot = 0; slot < CGRAM_SLOTS && victim < 0; slot++) {
+    if (!rpilcd_core_glyph_used(core, slot)) {
+      victim = slot;
+    }
+  }
+  for (slot = victim + 1; slot < CGRAM_SLOTS && victim >= 0; slot++) {
+    if (core->glyphs[slot].lastUse < core->glyphs[victim].lastUse &&
+        !rpilcd_core_glyph_used(core, slot)) {
+      victim = slot;
+    }
+  }
+  if (victim < 0) {
+    core->glyphMisses++;
+    return -1;
+  }
+
+  memcpy(core->glyphs[victim].bitmap, pixels, GLYPH_ROWS);
+  core->glyphs[victim].valid = true;
+  core->glyphs[victim].upload = true;
+  core->glyphs[victim].lastUse = core->glyphClock;
+  return GLYPH_BASE + victim;
+}
+
+/*
+ * Put a custom character in the lines, the cursor does not move
+ */
+void rpilcd_core_put_glyph(struct rpilcd_core_t *core, const struct rpilcd_glyph *glyph) {
+  const int col = rpilcd_clamp(glyph->col, 1, core->cols) - 1;
+  char cells[MAX_LEN];
+  int code = rpilcd_core_glyph(core, glyph->bitmap);
+
+  cells[col] = (code >= 0) ? code : glyph->fallback;
+  rpilcd_core_apply_cells(core, rpilcd_clamp(glyph->row, 1, core->rows), 1u << col, cells);
+}
+
+/*
+ * Cell of a bar filled height pixel rows from the bottom. Empty and full
+ * cells come from the character ROM, partial ones are glyphs, or the
+ * nearest ROM character when CGRAM is full.
+ */
+static char rpilcd_core_bar_cell(struct rpilcd_core_t *core, const int height) {
+  unsigned char bitmap[GLYPH_ROWS];
+  int code, i;
+
+  if (height <= 0) {
+    return ' ';
+  }
+  if (height >= GLYPH_ROWS) {
+    return FULL_BLOCK;
+  }
+  for (i = 0; i < GLYPH_ROWS; i++) {
+    bitmap[i] = (i >= GLYPH_ROWS - height) ? 0x1F : 0x00;
+  }
+  code = rpilcd_core_glyph(core, bitmap);
+  if (code < 0) {
+    return (height >= GLYPH_ROWS / 2) ? FULL_BLOCK : ' ';
+  }
+  return code;
+}
+
+/*
+ * Render a bar graph into the lines, the cursor does not move. Every cell
+ * is stored as soon as it is chosen so the following lookups don't evict
+ * its glyph.
+ */
+void rpilcd_core_apply_bars(struct rpilcd_core_t *core, const struct rpilcd_bars *bars) {
+  const int rows = rpilcd_clamp(bars->rows, 1, core->rows);
+  const int top = rpilcd_clamp(bars->row, 1, core->rows - rows + 1);
+  const int max = (bars->max > 0) ? bars->max : 255;
+  const int first = rpilcd_clamp(bars->col, 1, core->cols) - 1;
+  const int count = (bars->count < core->cols - first) ? bars->count : core->cols - first;
+  char cells[MAX_LEN];
+  int i, r;
+
+  for (i = 0; i < count; i++) {
+    const int value = (bars->values[i] < max) ? bars->values[i] : max;
+    const int height = (value * rows * GLYPH_ROWS + max / 2) / max;
+    /* r == 0 is the bottom line */
+    for (r = 0; r < rows; r++) {
+      cells[first + i] = rpilcd_core_bar_cell(core, height - r * GLYPH_ROWS);
+      rpilcd_core_apply_cells(core, top + rows - 1 - r, 1u << (first + i), cells);
+    }
+  }
+}
+
+/*===============================================================================================*/
+/*
+ * Start, replace or stop (period_ms == 0) the marquee, the next flush
+ * loads or takes it down. Panels of more than 2 lines can't have one.
+ */
+void rpilcd_core_apply_marquee(struct rpilcd_core_t *core, const struct rpilcd_marquee *marquee) {
+  struct rpilcd_marquee_t * const mq = &core->marquee;
+  const char *lines[2] = { marquee->line1, marquee->line2 };
+  int line, i;
+
+  if (marquee->period_ms == 0 || core->rows > 2) {
+    if (mq->active) {
+      mq->active = false;
+      mq->load = false;
+      mq->unload = true;
+    }
+    return;
+  }
+  for (line = 0; line < 2; line++) {
+    const size_t len = strnlen(lines[line], RPILCD_MARQUEE_LEN);
+    for (i = 0; i < RPILCD_MARQUEE_LEN; i++) {
+      mq->text[line][i] = (i < (int)len) ? lines[line][i] : ' ';
+    }
+  }
+  mq->period = (marquee->period_ms > MARQUEE_MIN_MS) ? marquee->period_ms : MARQUEE_MIN_MS;
+  mq->steps = marquee->steps;
+  mq->active = true;
+  mq->load = true;
+  mq->unload = false;
+}
+
+/*
+ * Shift the display one cell left. Returns false when no marquee runs any
+ * more, after the last of its steps the next flush puts the lines back.
+ */
+bool rpilcd_core_marquee_step(struct rpilcd_core_t *core) {
+  struct rpilcd_marquee_t * const mq = &core->marquee;
+
+  if (!mq->active || mq->load) {
+    return mq->active;
+  }
+  rpilcd_core_send(core, 0, 0x18);
+  /* the controller wraps the shift at its line length, 80 cells on 1 line */
+  mq->shift = (mq->shift + 1) % (RPILCD_MARQUEE_LEN * ((core->rows > 1) ? 1 : 2));
+  rpilcd_core_marquee_shadow(core, mq->shift);
+  core->marqueeSteps++;
+  if (mq->steps > 0 && --mq->steps == 0) {
+    mq->active = false;
+    mq->unload = true;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,139 @@
+#ifndef RPILCD_CORE_H_
+#define RPILCD_CORE_H_
+/*
+ * Hardware independent part of the rpilcd driver, see rpilcd_core.c
+ */
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#endif
+
+#include "rpilcd_ioctl.h"
+
+/**
+ * Largest supported panel, the geometry of each panel is in the core
+ */
+#define MAX_LEN   RPILCD_MAX_COLS
+#define MAX_ROWS  RPILCD_MAX_ROWS
+
+/**
+ * CGRAM holds 8 custom characters. They are put in the lines as codes
+ * 0x08..0x0F, which the controller mirrors to 0x00..0x07, so a line stays
+ * a NUL terminated string.
+ */
+#define CGRAM_SLOTS   8
+#define GLYPH_BASE    0x08
+#define GLYPH_ROWS    8
+#define FULL_BLOCK    0xFF    /* character ROM A00 */
+
+/**
+ * Bus to the controller. write() sends one command (rs == 0) or one
+ * character (rs == 1) and returns once the controller is ready again.
+ */
+struct rpilcd_bus_t {
+  void (*write)(void *ctx, int rs, unsigned char byte);
+};
+
+/**
+ * CGRAM slot, least recently used one is replaced first
+ */
+struct rpilcd_glyph_slot_t {
+  unsigned char bitmap[GLYPH_ROWS];
+  bool valid;
+  bool upload;                    /* not in CGRAM yet, sent by the next flush */
+  unsigned int lastUse;
+};
+
+/**
+ * State of the write() parser, kept between writes so a sequence may be
+ * split over several of them. CSI sequences take up to PARSE_PARAMS
+ * numeric parameters, further ones are ignored.
+ */
+#define PARSE_PARAMS  2
+#define PARSE_MAX     999
+enum rpilcd_parse_state {
+  PARSE_TEXT,
+  PARSE_BACKSLASH,                /* \n, \p, \r, \l, \d, \c of the old driver */
+  PARSE_ESC,
+  PARSE_CSI,                      /* ESC [ */
+};
+struct rpilcd_parser_t {
+  enum rpilcd_parse_state state;
+  bool priv;                      /* ESC [ ? ..., parsed and ignored */
+  int param;                      /* index of the parameter being read */
+  int params[PARSE_PARAMS];       /* 0 when not given */
+};
+
+/**
+ * Marquee of RPILCD_IOC_MARQUEE. While it runs the shadow holds the
+ * visible cells and flushes leave the lines for later.
+ */
+#define MARQUEE_MIN_MS  50        /* a command may take 5 ms on the bus */
+struct rpilcd_marquee_t {
+  bool active;
+  bool load;                      /* text not in DDRAM yet, sent by the next flush */
+  bool unload;                    /* stopped, the next flush puts the lines back */
+  bool cursorOff;                 /* the cursor was hidden for it */
+  int shift;                      /* cells shifted left */
+  unsigned int period;            /* ms between steps */
+  unsigned int steps;             /* left before it stops, 0 when unlimited */
+  char text[2][RPILCD_MARQUEE_LEN];
+};
+
+/**
+ * Text model of the display: content of the lines, cursor, and a shadow
+ * of the cells currently on the glass
+ */
+struct rpilcd_core_t {
+  int rows;                       /* geometry of the panel */
+  int cols;
+  int curRow;
+  int curCol;
+  bool wrapPending;               /* a character went to the last column */
+  int savedRow;                   /* ESC 7, ESC [ s */
+  int savedCol;
+  char lines[MAX_ROWS][MAX_LEN+1];
+  struct rpilcd_parser_t parser;
+
+  /* cells on the glass, address counter (acRow == 0 when unknown) */
+  char shadow[MAX_ROWS][MAX_LEN];
+  int acRow;
+  int acCol;
+
+  /* glyph cache over the CGRAM slots */
+  struct rpilcd_glyph_slot_t glyphs[CGRAM_SLOTS];
+  unsigned int glyphClock;
+  unsigned int glyphHits;
+  unsigned int glyphUploads;
+  unsigned int glyphMisses;       /* no free slot, fallback shown */
+
+  struct rpilcd_marquee_t marquee;
+  unsigned int marqueeSteps;
+
+  const struct rpilcd_bus_t *bus;
+  void *busCtx;
+  unsigned int busBytes;          /* bytes sent to the controller */
+};
+
+void rpilcd_core_init(struct rpilcd_core_t *core, const int rows, const int cols,
+                      const struct rpilcd_bus_t *bus, void *busCtx);
+void rpilcd_core_reset_shadow(struct rpilcd_core_t *core);
+void rpilcd_core_apply_write(struct rpilcd_core_t *core, const char *buff, size_t count);
+void rpilcd_core_apply_frame(struct rpilcd_core_t *core, const struct rpilcd_frame *frame);
+void rpilcd_core_set_cursor(struct rpilcd_core_t *core, const int row, const int col);
+void rpilcd_core_apply_cells(struct rpilcd_core_t *core, const int row, const unsigned int mask,
+                             const char *cells);
+int rpilcd_core_glyph(struct rpilcd_core_t *core, const unsigned char *bitmap);
+void rpilcd_core_put_glyph(struct rpilcd_core_t *core, const struct rpilcd_glyph *glyph);
+void rpilcd_core_apply_bars(struct rpilcd_core_t *core, const struct rpilcd_bars *bars);
+void rpilcd_core_apply_marquee(struct rpilcd_core_t *core, const struct rpilcd_marquee *marquee);
+bool rpilcd_core_marquee_step(struct rpilcd_core_t *core);
+unsigned int rpilcd_core_flush(struct rpilcd_core_t *core);
+size_t rpilcd_core_snapshot(const struct rpilcd_core_t *core, char *buf);
+
+#endif //RPILCD_CORE_H_
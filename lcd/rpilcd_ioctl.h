@@ -0,0 +1,139 @@
+#ifndef RPILCD_IOCTL_H_
+#define RPILCD_IOCTL_H_
+/*
+ * ioctl interface of /dev/rpilcdN, shared by the driver and userspace
+ */
+#ifdef __KERNEL__
+#include <linux/ioctl.h>
+#else
+#include <sys/ioctl.h>
+#endif
+
+#define RPILCD_ROWS     2       /* size of struct rpilcd_frame */
+#define RPILCD_COLS     16
+
+#define RPILCD_MAX_ROWS 4       /* largest panel, e.g. 20x4 */
+#define RPILCD_MAX_COLS 20
+
+/**
+ * Content of the first two lines, the other lines of a bigger panel are
+ * left as they are. Lines are not NUL terminated, a shorter line is
+ * padded with '\0'. Cursor position starts from row=1 and column=1.
+ */
+struct rpilcd_frame {
+  char          line1[RPILCD_COLS];
+  char          line2[RPILCD_COLS];
+  unsigned char row;
+  unsigned char col;
+};
+
+/**
+ * Layout of the page returned by mmap() on /dev/rpilcdN, only the first
+ * rows x cols cells are used. The mapping must be MAP_SHARED, the driver
+ * refuses MAP_PRIVATE with EINVAL. The application writes cells directly, sets the bit of every changed column in dirty[]
+ * (bit 0 is column 1) and asks for a flush with RPILCD_IOC_FLUSH_MAP. The
+ * driver clears the bits it has taken. msync(MS_SYNC) or fsync() do the
+ * same and also wait until the cells are on the glass.
+ * A cell holding '\0' is shown as a space. row == 0 leaves the cursor
+ * where it is, otherwise it is moved to row/col on the next flush.
+ */
+struct rpilcd_map {
+  unsigned int  rows;                     /* geometry, set by the driver */
+  unsigned int  cols;
+  unsigned int  dirty[RPILCD_MAX_ROWS];
+  unsigned char row;
+  unsigned char col;
+  unsigned char reserved[2];
+  char          cells[RPILCD_MAX_ROWS][RPILCD_MAX_COLS];
+};
+
+/**
+ * Custom character of 5x8 pixels, bitmap[0] is the top pixel row (low 5
+ * bits). The driver keeps it in one of the 8 CGRAM slots while it is on
+ * screen and only uploads it when it is not already there. When every
+ * slot holds a glyph still on screen, fallback is shown instead.
+ */
+struct rpilcd_glyph {
+  unsigned char bitmap[8];
+  unsigned char row;
+  unsigned char col;
+  char          fallback;
+  unsigned char reserved;
+};
+
+/**
+ * Bar graph of count columns starting at row/col, values scaled to max.
+ * With rows == 1 a bar has 8 levels within its line (a sparkline), with
+ * more rows it spans that many lines from row down, 8 levels per line.
+ * The graph is moved up when it would not fit below row.
+ */
+struct rpilcd_bars {
+  unsigned char row;
+  unsigned char col;
+  unsigned char rows;
+  unsigned char count;
+  unsigned char max;
+  unsigned char reserved[3];
+  unsigned char values[RPILCD_MAX_COLS];
+};
+
+/**
+ * Text scrolled by the controller itself: each line is loaded once into
+ * the RPILCD_MARQUEE_LEN cells of its DDRAM line, then the display is
+ * shifted one cell left every period_ms, a single command per step. The
+ * text wraps around after the last cell, a shorter line is padded with
+ * spaces. The controller shifts both lines together. It runs for steps
+ * shifts, or until period_ms == 0 stops it. Other requests meanwhile
+ * update the screen behind the marquee, which is back when it stops.
+ * Only panels of 1 or 2 lines: lines 3 and 4 share DDRAM with 1 and 2.
+ */
+#define RPILCD_MARQUEE_LEN    40
+struct rpilcd_marquee {
+  char           line1[RPILCD_MARQUEE_LEN];
+  char           line2[RPILCD_MARQUEE_LEN];
+  unsigned short period_ms;
+  unsigned short steps;                   /* 0 runs until stopped */
+};
+
+/**
+ * write() takes a stream of text and control sequences of any length,
+ * applied in order and drawn with one flush per write(). A sequence may
+ * be split over several writes. Text overwrites the cells from the
+ * cursor and continues on the next line; characters past the last cell
+ * are dropped.
+ *   \n LF   next line, column 1       \r CR   column 1
+ *   \b BS   one cell left             \f FF   clear, cursor home
+ *   ESC [ r;c H   cursor to row r, column c (also f), from 1
+ *   ESC [ n A/B/C/D   n cells up/down/right/left     ESC [ n G   column n
+ *   ESC [ n J   erase display, ESC [ n K   erase line: n = 0 from the
+ *               cursor, 1 up to the cursor, 2 everything
+ *   ESC [ s / ESC 7   save the cursor    ESC [ u / ESC 8   restore it
+ *   ESC c   clear and home
+ * The escapes of the old driver still work within the stream: "\\n",
+ * "\\p" next and previous line, "\\r", "\\l" right and left, "\\d"
+ * delete, "\\c" clear, and "\\\\" is a backslash. Other control
+ * characters and ESC [ ? sequences are ignored.
+ */
+
+/**
+ * read() returns the cells on the glass, one line of cols characters per
+ * row ended by '\n', then the cursor as "rr cc\n". Codes 0x08..0x0F are
+ * custom characters. The size is fixed for a panel, so lseek() or pread()
+ * can pick a row. poll() reports POLLIN when the glass changed since the
+ * last read from offset 0; reads never wait for the bus.
+ */
+#define RPILCD_SNAPSHOT_MAX   (RPILCD_MAX_ROWS * (RPILCD_MAX_COLS + 1) + 6)
+
+#define RPILCD_IOC_MAGIC      'L'
+/* replace both lines and the cursor with a single repaint */
+#define RPILCD_IOC_SET_FRAME  _IOW(RPILCD_IOC_MAGIC, 1, struct rpilcd_frame)
+/* draw the dirty cells of the mmap()ed buffer */
+#define RPILCD_IOC_FLUSH_MAP  _IO(RPILCD_IOC_MAGIC, 2)
+/* show a custom character */
+#define RPILCD_IOC_PUT_GLYPH  _IOW(RPILCD_IOC_MAGIC, 3, struct rpilcd_glyph)
+/* draw a bar graph with custom characters */
+#define RPILCD_IOC_BARS       _IOW(RPILCD_IOC_MAGIC, 4, struct rpilcd_bars)
+/* start, replace or stop a marquee, -EINVAL on panels of more than 2 lines */
+#define RPILCD_IOC_MARQUEE    _IOW(RPILCD_IOC_MAGIC, 5, struct rpilcd_marquee)
+
+#endif //RPILCD_IOCTL_H_
@@ -0,0 +1,215 @@
+// Cost of continuous LCD updates for the other tasks on the Pi.
+//
+// gcc -O2 -o rpilcd_load rpilcd_load.c -lpthread -std=gnu99
+// ./rpilcd_load [-d /dev/rpilcd0] [-t seconds]
+//
+// Runs three phases of -t seconds: without LCD updates, then with a
+// writer repainting the panel as fast as it can (RPILCD_IOC_SET_FRAME
+// followed by fsync(), so every update goes to the bus) once with
+// txtimer=0 (delays in the worker) and once with txtimer=1 (hrtimer).
+// Switching the module parameter needs root, otherwise the current
+// setting is measured twice.
+//
+// Meanwhile two co-located tasks run: a periodic one sleeping 1 ms,
+// whose wake up latency is reported, and a CPU bound one, whose loop
+// count shows the CPU time left to it. The system, irq and softirq time
+// of /proc/stat is the CPU time taken by the kernel, the driver included.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+#include "rpilcd_ioctl.h"
+
+#define TXTIMER_PARAM   "/sys/module/rpilcd_module/parameters/txtimer"
+#define PERIOD_NS       1000000
+#define MAX_SAMPLES     (1 << 20)
+
+static volatile int running = 0;
+static volatile int stop = 0;
+
+// ---------------------------------------------------
+// CO-LOCATED TASKS
+// ---------------------------------------------------
+static uint32_t latencies[MAX_SAMPLES];
+static size_t samples = 0;
+static volatile uint64_t spins = 0;
+
+static int64_t ns_between(const struct timespec *a, const struct timespec *b) {
+  return (int64_t)(b->tv_sec - a->tv_sec) * 1000000000 + (b->tv_nsec - a->tv_nsec);
+}
+
+static void *periodic_task(void *arg) {
+  struct timespec next, now;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (!stop) {
+    next.tv_nsec += PERIOD_NS;
+    if (next.tv_nsec >= 1000000000) {
+      next.tv_nsec -= 1000000000;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (running && samples < MAX_SAMPLES) {
+      latencies[samples++] = (uint32_t)ns_between(&next, &now);
+    }
+  }
+  return NULL;
+}
+
+static void *cpu_task(void *arg) {
+  while (!stop) {
+    if (running) {
+      spins++;
+    }
+  }
+  return NULL;
+}
+
+// ---------------------------------------------------
+// LCD WRITER
+// ---------------------------------------------------
+static int lcd_fd = -1;
+static volatile uint64_t updates = 0;
+
+static void *writer_task(void *arg) {
+  struct rpilcd_frame frame;
+  uint64_t n = 0;
+  while (!stop) {
+    if (!running || lcd_fd < 0) {
+      usleep(1000);
+      continue;
+    }
+    memset(&frame, 0, sizeof(frame));
+    snprintf(frame.line1, sizeof(frame.line1), "load %llu", (unsigned long long)n);
+    snprintf(frame.line2, sizeof(frame.line2), "%015llx", (unsigned long long)(n * 2654435761u));
+    frame.row = 1;
+    frame.col = 1;
+    if (ioctl(lcd_fd, RPILCD_IOC_SET_FRAME, &frame) != 0 || fsync(lcd_fd) != 0) {
+      perror("rpilcd");
+      stop = 1;
+      break;
+    }
+    n++;
+    updates = n;
+  }
+  return NULL;
+}
+
+// ---------------------------------------------------
+// MEASUREMENT
+// ---------------------------------------------------
+static uint64_t kernel_ticks(void) {
+  // cpu user nice system idle iowait irq softirq
+  unsigned long long v[7] = { 0 };
+  FILE *f = fopen("/proc/stat", "r");
+  if (f == NULL) {
+    return 0;
+  }
+  if (fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu",
+             &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]) != 7) {
+    v[2] = v[5] = v[6] = 0;
+  }
+  fclose(f);
+  return v[2] + v[5] + v[6];
+}
+
+static int set_txtimer(int on) {
+  FILE *f = fopen(TXTIMER_PARAM, "w");
+  if (f == NULL) {
+    return -1;
+  }
+  fprintf(f, "%d\n", on);
+  return fclose(f);
+}
+
+static int cmp_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void run_phase(const char *name, int lcd, int seconds) {
+  const long hz = sysconf(_SC_CLK_TCK);
+  uint64_t ticks, upd;
+  double avg = 0;
+  size_t i;
+
+  samples = 0;
+  spins = 0;
+  updates = 0;
+  lcd_fd = lcd;
+  ticks = kernel_ticks();
+  running = 1;
+  sleep(seconds);
+  running = 0;
+  ticks = kernel_ticks() - ticks;
+  upd = updates;
+  lcd_fd = -1;
+
+  qsort(latencies, samples, sizeof(latencies[0]), cmp_u32);
+  for (i = 0; i < samples; i++) {
+    avg += latencies[i];
+  }
+  avg = samples ? avg / samples : 0;
+  printf("%-14s %8.1f %10.1f %10.1f %10.1f %12.2f %10.1f\n", name,
+         (double)upd / seconds,
+         avg / 1000,
+         samples ? latencies[samples * 99 / 100] / 1000.0 : 0,
+         samples ? latencies[samples - 1] / 1000.0 : 0,
+         (double)spins / seconds / 1e6,
+         hz > 0 ? 100.0 * ticks / hz / seconds : 0);
+}
+
+int main(int argc, char **argv) {
+  const char *dev = "/dev/rpilcd0";
+  int seconds = 10;
+  pthread_t threads[3];
+  int opt, fd;
+
+  while ((opt = getopt(argc, argv, "d:t:")) != -1) {
+    switch (opt) {
+      case 'd':
+        dev = optarg;
+        break;
+      case 't':
+        seconds = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-d device] [-t seconds]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  fd = open(dev, O_RDWR);
+  if (fd < 0) {
+    perror(dev);
+    return 1;
+  }
+
+  pthread_create(&threads[0], NULL, periodic_task, NULL);
+  pthread_create(&threads[1], NULL, cpu_task, NULL);
+  pthread_create(&threads[2], NULL, writer_task, NULL);
+
+  printf("%-14s %8s %10s %10s %10s %12s %10s\n", "phase", "upd/s", "lat avg us",
+         "lat p99 us", "lat max us", "Mspins/s", "kernel %");
+  run_phase("idle lcd", -1, seconds);
+  if (set_txtimer(0) != 0) {
+    fprintf(stderr, "cannot write %s, measuring the current mode\n", TXTIMER_PARAM);
+  }
+  run_phase("txtimer=0", fd, seconds);
+  set_txtimer(1);
+  run_phase("txtimer=1", fd, seconds);
+
+  stop = 1;
+  pthread_join(threads[0], NULL);
+  pthread_join(threads[1], NULL);
+  pthread_join(threads[2], NULL);
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,90 @@
+#include "rpilcd_pcf8574.h"
+
+/*
+ * Expander writes for an HD44780 on a PCF8574 backpack, shared by the
+ * kernel module and the host simulator in sim/. Nothing in here touches
+ * the bus, messages go through pcf->xfer.
+ *
+ * Every level change of a pin is a write to the expander, so instead of
+ * one I2C transaction per write the writes are packed into one message
+ * per flush. The bus paces them: at 100 or 400 kHz a byte of the
+ * controller (four writes, 36 clocks) takes longer than the 37-41 us it
+ * needs to execute. Only clear and return home need more, the message
+ * ends after them and the next one starts PCF8574_SLOW_US later.
+ */
+
+/*===============================================================================================*/
+void rpilcd_pcf8574_init(struct rpilcd_pcf8574_t *pcf, const unsigned int batch,
+                         rpilcd_pcf8574_xfer_t xfer, void *ctx) {
+  memset(pcf, 0, sizeof(*pcf));
+  pcf->batch = (batch >= 1 && batch <= PCF8574_BATCH) ? batch : PCF8574_BATCH;
+  pcf->backlight = PCF8574_BL;
+  pcf->last = PCF8574_BL;
+  pcf->xfer = xfer;
+  pcf->ctx = ctx;
+}
+
+/*
+ * Send what is queued and the wait after it, if any
+ */
+int rpilcd_pcf8574_flush(struct rpilcd_pcf8574_t *pcf) {
+  int ret = 0;
+
+  if (pcf->len == 0 && pcf->waitUs == 0) {
+    return 0;
+  }
+  ret = pcf->xfer(pcf->ctx, pcf->buf, pcf->len, pcf->waitUs);
+  if (ret < 0) {
+    pcf->errors++;
+  }
+  else {
+    pcf->transfers += ret;
+  }
+  pcf->bytes += pcf->len;
+  pcf->waitTotalUs += pcf->waitUs;
+  pcf->len = 0;
+  pcf->waitUs = 0;
+  return (ret < 0) ? ret : 0;
+}
+
+static void rpilcd_pcf8574_out(struct rpilcd_pcf8574_t *pcf, const unsigned char value) {
+  if (pcf->len == pcf->batch) {
+    rpilcd_pcf8574_flush(pcf);
+  }
+  pcf->buf[pcf->len++] = value;
+  pcf->last = value;
+}
+
+/*
+ * Latch the low 4 bits of nibble on D4..D7: EN high then low with the
+ * same data. RS must be stable before EN rises, so a change of RS costs
+ * one more write.
+ */
+void rpilcd_pcf8574_nibble(struct rpilcd_pcf8574_t *pcf, const int rs, const unsigned char nibble) {
+  const unsigned char value = ((nibble & 0x0F) << 4) | (rs ? PCF8574_RS : 0) | pcf->backlight;
+
+  if ((pcf->last & PCF8574_RS) != (value & PCF8574_RS)) {
+    rpilcd_pcf8574_out(pcf, value);
+  }
+  rpilcd_pcf8574_out(pcf, value | PCF8574_EN);
+  rpilcd_pcf8574_out(pcf, value);
+}
+
+/*
+ * Queue a command (rs == 0) or a character (rs == 1), high nibble first
+ */
+void rpilcd_pcf8574_byte(struct rpilcd_pcf8574_t *pcf, const int rs, const unsigned char byte) {
+  rpilcd_pcf8574_nibble(pcf, rs, byte >> 4);
+  rpilcd_pcf8574_nibble(pcf, rs, byte);
+  if (!rs && (byte == 0x01 || (byte & 0xFE) == 0x02)) {
+    rpilcd_pcf8574_wait(pcf, PCF8574_SLOW_US);
+  }
+}
+
+/*
+ * The controller needs us before the next write, ends the message
+ */
+void rpilcd_pcf8574_wait(struct rpilcd_pcf8574_t *pcf, const unsigned int us) {
+  pcf->waitUs += us;
+  rpilcd_pcf8574_flush(pcf);
+}
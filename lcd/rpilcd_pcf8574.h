@@ -0,0 +1,58 @@
+#ifndef RPILCD_PCF8574_H_
+#define RPILCD_PCF8574_H_
+/*
+ * HD44780 behind a PCF8574 I2C expander ("backpack"), see rpilcd_pcf8574.c
+ */
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/string.h>
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#endif
+
+/**
+ * Usual wiring of the backpacks: P0 RS, P1 RW, P2 EN, P3 backlight,
+ * P4..P7 D4..D7, so the controller runs on a 4 bit bus
+ */
+#define PCF8574_RS        0x01
+#define PCF8574_RW        0x02
+#define PCF8574_EN        0x04
+#define PCF8574_BL        0x08
+
+#define PCF8574_BATCH     512     /* largest message, in expander writes */
+#define PCF8574_SLOW_US   2000    /* clear and return home take 1.52 ms */
+
+/**
+ * Sends len expander writes to the backpack, then waits waitUs. Returns
+ * the number of bus transactions it took, or a negative error.
+ */
+typedef int (*rpilcd_pcf8574_xfer_t)(void *ctx, const unsigned char *buf, unsigned int len,
+                                     unsigned int waitUs);
+
+struct rpilcd_pcf8574_t {
+  unsigned char buf[PCF8574_BATCH];
+  unsigned int len;
+  unsigned int batch;             /* message size limit, at most PCF8574_BATCH */
+  unsigned int waitUs;            /* wait after the pending message */
+  unsigned char last;             /* last write queued, the pins the expander drives */
+  unsigned char backlight;        /* PCF8574_BL or 0 */
+  rpilcd_pcf8574_xfer_t xfer;
+  void *ctx;
+
+  /* statistics */
+  unsigned int transfers;         /* bus transactions */
+  unsigned int bytes;             /* expander writes, without the address bytes */
+  unsigned int errors;
+  unsigned int waitTotalUs;
+};
+
+void rpilcd_pcf8574_init(struct rpilcd_pcf8574_t *pcf, const unsigned int batch,
+                         rpilcd_pcf8574_xfer_t xfer, void *ctx);
+void rpilcd_pcf8574_nibble(struct rpilcd_pcf8574_t *pcf, const int rs, const unsigned char nibble);
+void rpilcd_pcf8574_byte(struct rpilcd_pcf8574_t *pcf, const int rs, const unsigned char byte);
+void rpilcd_pcf8574_wait(struct rpilcd_pcf8574_t *pcf, const unsigned int us);
+int rpilcd_pcf8574_flush(struct rpilcd_pcf8574_t *pcf);
+
+#endif //RPILCD_PCF8574_H_
@@ -0,0 +1,84 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM rpilcd
+
+#if !defined(RPILCD_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define RPILCD_TRACE_H_
+/*
+ * Tracepoints of the rpilcd driver, e.g.
+ *   perf record -e 'rpilcd:*' -a
+ * or events/rpilcd/ in tracefs
+ */
+#include <linux/tracepoint.h>
+
+/* write() on /dev/rpilcdN, before the request is queued */
+TRACE_EVENT(rpilcd_write,
+  TP_PROTO(int minor, size_t count),
+  TP_ARGS(minor, count),
+  TP_STRUCT__entry(
+    __field(int, minor)
+    __field(size_t, count)
+  ),
+  TP_fast_assign(
+    __entry->minor = minor;
+    __entry->count = count;
+  ),
+  TP_printk("rpilcd%d count=%zu", __entry->minor, __entry->count)
+);
+
+/* the worker applies one queued request to the text model */
+TRACE_EVENT(rpilcd_parse,
+  TP_PROTO(int minor, int type, size_t count),
+  TP_ARGS(minor, type, count),
+  TP_STRUCT__entry(
+    __field(int, minor)
+    __field(int, type)
+    __field(size_t, count)
+  ),
+  TP_fast_assign(
+    __entry->minor = minor;
+    __entry->type = type;
+    __entry->count = count;
+  ),
+  TP_printk("rpilcd%d type=%d count=%zu", __entry->minor, __entry->type, __entry->count)
+);
+
+/* the worker starts drawing the requests it has applied */
+TRACE_EVENT(rpilcd_flush_start,
+  TP_PROTO(int minor, unsigned int requests),
+  TP_ARGS(minor, requests),
+  TP_STRUCT__entry(
+    __field(int, minor)
+    __field(unsigned int, requests)
+  ),
+  TP_fast_assign(
+    __entry->minor = minor;
+    __entry->requests = requests;
+  ),
+  TP_printk("rpilcd%d requests=%u", __entry->minor, __entry->requests)
+);
+
+/* everything is on the glass */
+TRACE_EVENT(rpilcd_flush_end,
+  TP_PROTO(int minor, unsigned int bytes, s64 us),
+  TP_ARGS(minor, bytes, us),
+  TP_STRUCT__entry(
+    __field(int, minor)
+    __field(unsigned int, bytes)
+    __field(s64, us)
+  ),
+  TP_fast_assign(
+    __entry->minor = minor;
+    __entry->bytes = bytes;
+    __entry->us = us;
+  ),
+  TP_printk("rpilcd%d bytes=%u us=%lld", __entry->minor, __entry->bytes, __entry->us)
+);
+
+#endif //RPILCD_TRACE_H_
+
+/* this part must be outside the header guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE rpilcd_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,321 @@
+// Host timing of the GPIO work per byte of the rpilcd driver, before and
+// after the descriptor rewrite, against a stand-in for the GPIO layer.
+//
+// make -C lcd gpiobench && lcd/rpilcd_gpio_bench [bytes]
+//
+// The stand-in keeps the shape of gpiolib on a BCM2835: every call looks
+// up its line, takes the chip lock and writes the GPSET0/GPCLR0 register
+// or reads GPLEV0. Three paths send the same bytes:
+//   legacy       gpio_set_value() per data line, gpio_get_value(RS) twice
+//                per byte to pick the delay (the driver before the rewrite)
+//   array        gpiod_set_array_value() on a chip with set_multiple: one
+//                register write per level for the four lines
+//   array/noset  the same on a chip without set_multiple, gpiolib sets
+//                the lines one by one (pinctrl-bcm2835 on 4.4)
+// and the table gives calls and register accesses per byte, the time of
+// the GPIO calls alone and with the udelay(1) of each EN pulse, and the
+// bytes per second of the latter. The execution delays after a byte are
+// the same on every path and left out. Every path is checked against the
+// nibbles a panel would latch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define LCD_RS    26
+#define LCD_EN    19
+#define LCD_D4    13
+#define LCD_D5    6
+#define LCD_D6    5
+#define LCD_D7    11
+#define NGPIO     54
+
+// ---------------------------------------------------
+// GPIO STAND-IN
+// ---------------------------------------------------
+struct chip {
+  volatile uint32_t set[2];       // GPSET0/1
+  volatile uint32_t clr[2];       // GPCLR0/1
+  volatile uint32_t lev[2];       // GPLEV0/1, follows set and clr
+  volatile int lock;
+  int multiple;                   // has set_multiple
+  unsigned long calls;            // into the GPIO layer
+  unsigned long regs;             // register accesses
+};
+
+struct desc {
+  struct chip *chip;
+  unsigned int offset;
+  unsigned long flags;
+};
+
+static struct chip chip;
+static struct desc descs[NGPIO];
+
+// what the panel latches on each falling edge of EN
+static unsigned char latched[1 << 16];
+static size_t nlatched = 0;
+
+static void chip_lock(struct chip *c) {
+  while (__atomic_exchange_n(&c->lock, 1, __ATOMIC_ACQUIRE)) {
+  }
+}
+
+static void chip_unlock(struct chip *c) {
+  __atomic_store_n(&c->lock, 0, __ATOMIC_RELEASE);
+}
+
+static int level(const struct chip *c, unsigned int offset) {
+  return (c->lev[offset / 32] >> (offset % 32)) & 1;
+}
+
+// falling edge of EN: the data lines go to the panel
+static void latch(struct chip *c) {
+  unsigned char nibble = (level(c, LCD_D4) << 0) | (level(c, LCD_D5) << 1) |
+                         (level(c, LCD_D6) << 2) | (level(c, LCD_D7) << 3);
+  latched[nlatched++ % sizeof(latched)] = (level(c, LCD_RS) << 4) | nibble;
+}
+
+static void chip_write(struct chip *c, unsigned int bank, uint32_t setmask, uint32_t clrmask) {
+  const int en = level(c, LCD_EN);
+  if (setmask != 0) {
+    c->set[bank] = setmask;
+    c->regs++;
+  }
+  if (clrmask != 0) {
+    c->clr[bank] = clrmask;
+    c->regs++;
+  }
+  c->lev[bank] = (c->lev[bank] | setmask) & ~clrmask;
+  if (en && !level(c, LCD_EN)) {
+    latch(c);
+  }
+}
+
+static struct desc *gpio_to_desc(unsigned int gpio) {
+  return (gpio < NGPIO) ? &descs[gpio] : NULL;
+}
+
+// gpiod_set_raw_value() and friends: validate, lock, one register
+static void gpiod_set_value(struct desc *d, int value) {
+  struct chip *c = d->chip;
+  const uint32_t bit = 1u << (d->offset % 32);
+  c->calls++;
+  chip_lock(c);
+  chip_write(c, d->offset / 32, value ? bit : 0, value ? 0 : bit);
+  chip_unlock(c);
+}
+
+static int gpiod_get_value(struct desc *d) {
+  struct chip *c = d->chip;
+  int value;
+  c->calls++;
+  chip_lock(c);
+  value = (c->lev[d->offset / 32] >> (d->offset % 32)) & 1;
+  c->regs++;
+  chip_unlock(c);
+  return value;
+}
+
+// the legacy calls go through the descriptor of the number
+static void gpio_set_value(unsigned int gpio, int value) {
+  gpiod_set_value(gpio_to_desc(gpio), value);
+}
+
+static int gpio_get_value(unsigned int gpio) {
+  return gpiod_get_value(gpio_to_desc(gpio));
+}
+
+// one call; with set_multiple one write per level and bank, without it
+// one chip->set per line under the same lock
+static void gpiod_set_array_value(unsigned int n, struct desc **array, const int *values) {
+  struct chip *c = array[0]->chip;
+  unsigned int i;
+  c->calls++;
+  chip_lock(c);
+  if (c->multiple) {
+    uint32_t setmask[2] = { 0, 0 };
+    uint32_t clrmask[2] = { 0, 0 };
+    for (i = 0; i < n; i++) {
+      const unsigned int off = array[i]->offset;
+      if (values[i]) {
+        setmask[off / 32] |= 1u << (off % 32);
+      }
+      else {
+        clrmask[off / 32] |= 1u << (off % 32);
+      }
+    }
+    chip_write(c, 0, setmask[0], clrmask[0]);
+    if (setmask[1] != 0 || clrmask[1] != 0) {
+      chip_write(c, 1, setmask[1], clrmask[1]);
+    }
+  }
+  else {
+    for (i = 0; i < n; i++) {
+      const uint32_t bit = 1u << (array[i]->offset % 32);
+      chip_write(c, array[i]->offset / 32, values[i] ? bit : 0, values[i] ? 0 : bit);
+    }
+  }
+  chip_unlock(c);
+}
+
+// udelay(1) with EN high, spun as the kernel does, or left out to time
+// the GPIO calls alone
+static int spin_en = 1;
+
+static void udelay1(void) {
+  struct timespec start, now;
+  if (!spin_en) {
+    return;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  do {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+  } while ((now.tv_sec - start.tv_sec) * 1000000000L + (now.tv_nsec - start.tv_nsec) < 1000);
+}
+
+// ---------------------------------------------------
+// DRIVER PATHS
+// ---------------------------------------------------
+
+// nibbles sent with RS high, which the driver follows with udelay(200)
+static unsigned long data_nibbles = 0;
+
+// rpilcd_write_byte before the rewrite
+static void legacy_write_byte(unsigned char byte) {
+  gpio_set_value(LCD_D4, (byte >> 4) & 0x01);
+  gpio_set_value(LCD_D5, (byte >> 5) & 0x01);
+  gpio_set_value(LCD_D6, (byte >> 6) & 0x01);
+  gpio_set_value(LCD_D7, (byte >> 7) & 0x01);
+  gpio_set_value(LCD_EN, 1);
+  udelay1();
+  gpio_set_value(LCD_EN, 0);
+  data_nibbles += gpio_get_value(LCD_RS);
+  gpio_set_value(LCD_D4, byte & 0x01);
+  gpio_set_value(LCD_D5, (byte >> 1) & 0x01);
+  gpio_set_value(LCD_D6, (byte >> 2) & 0x01);
+  gpio_set_value(LCD_D7, (byte >> 3) & 0x01);
+  gpio_set_value(LCD_EN, 1);
+  udelay1();
+  gpio_set_value(LCD_EN, 0);
+  data_nibbles += gpio_get_value(LCD_RS);
+}
+
+// rpilcd_gpio_put_nibble and rpilcd_gpio_write_byte now, RS in software
+static struct desc *data[4];
+static int rs_level = 0;
+
+static void array_put_nibble(unsigned char value) {
+  int values[4];
+  int i;
+  for (i = 0; i < 4; i++) {
+    values[i] = (value >> i) & 0x01;
+  }
+  gpiod_set_array_value(4, data, values);
+  gpiod_set_value(gpio_to_desc(LCD_EN), 1);
+  udelay1();
+  gpiod_set_value(gpio_to_desc(LCD_EN), 0);
+}
+
+static void array_write_byte(unsigned char byte) {
+  array_put_nibble(byte >> 4);
+  data_nibbles += rs_level;
+  array_put_nibble(byte & 0x0F);
+  data_nibbles += rs_level;
+}
+
+// ---------------------------------------------------
+// MAIN
+// ---------------------------------------------------
+enum path { LEGACY, ARRAY, ARRAY_NOSET, PATHS };
+static const char *path_names[PATHS] = { "legacy", "array", "array/noset" };
+
+static void chip_init(int multiple) {
+  int i;
+  memset((void *)&chip, 0, sizeof(chip));
+  chip.multiple = multiple;
+  for (i = 0; i < NGPIO; i++) {
+    descs[i].chip = &chip;
+    descs[i].offset = i;
+  }
+  data[0] = gpio_to_desc(LCD_D4);
+  data[1] = gpio_to_desc(LCD_D5);
+  data[2] = gpio_to_desc(LCD_D6);
+  data[3] = gpio_to_desc(LCD_D7);
+  nlatched = 0;
+}
+
+static int64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// sends bytes on one path, returns the ns taken and counts the nibbles
+// the panel did not latch as sent
+static int64_t run(enum path p, long bytes, unsigned long *errors) {
+  int64_t start, ns;
+  long i;
+
+  chip_init(p != ARRAY_NOSET);
+  // data bytes, RS high as the driver leaves it while drawing text
+  if (p == LEGACY) {
+    gpio_set_value(LCD_RS, 1);
+  }
+  else {
+    gpiod_set_value(gpio_to_desc(LCD_RS), 1);
+    rs_level = 1;
+  }
+  chip.calls = 0;
+  chip.regs = 0;
+  data_nibbles = 0;
+  start = now_ns();
+  for (i = 0; i < bytes; i++) {
+    const unsigned char byte = (unsigned char)(i * 37 + 11);
+    if (p == LEGACY) {
+      legacy_write_byte(byte);
+    }
+    else {
+      array_write_byte(byte);
+    }
+  }
+  ns = now_ns() - start;
+
+  // what the panel latched last: RS high, the high then the low nibble
+  *errors = (nlatched != (size_t)bytes * 2 || data_nibbles != nlatched) ? 1 : 0;
+  for (i = nlatched > sizeof(latched) ? nlatched - sizeof(latched) : 0; i < (long)nlatched; i++) {
+    const unsigned char byte = (unsigned char)(i / 2 * 37 + 11);
+    const unsigned char nibble = (i % 2) ? (byte & 0x0F) : (byte >> 4);
+    if (latched[i % sizeof(latched)] != (0x10 | nibble)) {
+      (*errors)++;
+    }
+  }
+  return ns;
+}
+
+int main(int argc, char *argv[]) {
+  const long bytes = (argc > 1) ? atol(argv[1]) : 200000;
+  int p;
+
+  if (bytes < 1) {
+    fprintf(stderr, "usage: %s [bytes]\n", argv[0]);
+    return 1;
+  }
+  printf("%-12s %8s %8s %8s %11s %11s %11s %6s\n", "path", "bytes", "calls/B", "regs/B",
+         "gpio ns/B", "bus ns/B", "bytes/s", "errors");
+  for (p = 0; p < PATHS; p++) {
+    unsigned long errors = 0, spun_errors = 0;
+    int64_t gpio_ns, bus_ns;
+
+    spin_en = 0;
+    gpio_ns = run(p, bytes, &errors);
+    spin_en = 1;
+    bus_ns = run(p, bytes, &spun_errors);
+    printf("%-12s %8ld %8.2f %8.2f %11.1f %11.1f %11.0f %6lu\n", path_names[p], bytes,
+           (double)chip.calls / bytes, (double)chip.regs / bytes, (double)gpio_ns / bytes,
+           (double)bus_ns / bytes, bytes * 1e9 / bus_ns, errors + spun_errors);
+  }
+  return 0;
+}
@@ -0,0 +1,220 @@
+#include "hd44780_sim.h"
+
+#include <string.h>
+
+/*
+ * Execution times from the HD44780 datasheet (fosc = 270 kHz), in ns
+ */
+#define EXEC_CLEAR_NS     1520000
+#define EXEC_HOME_NS      1520000
+#define EXEC_CMD_NS       37000
+#define EXEC_DATA_NS      41000     /* 37 us + tADD */
+
+/*
+ * Driver side of the bus, see rpilcd_write_byte in device_file.c
+ */
+#define ENABLE_NS         1000      /* udelay(1) with EN high */
+#define FIXED_DATA_NS     200000    /* udelay(200) */
+#define FIXED_CMD_NS      5000000   /* usleep_range(4500, 5500) */
+#define BUSY_NIBBLE_NS    1000      /* udelay(1) between the two nibbles */
+#define BUSY_POLL_NS      4000      /* one busy flag read, two EN strobes */
+#define BUSY_POLL8_NS     2000      /* the same on an 8 bit bus, one strobe */
+#define BUSY_SLEEP_NS     15000     /* usleep_range(10, 20) between two reads */
+#define TIMER_DATA_NS     200000    /* EXEC_DATA_US after a byte */
+#define TIMER_CMD_NS      4500000   /* EXEC_CMD_US */
+#define TIMER_IRQ_NS      3000      /* one hrtimer interrupt, a guess for a Pi */
+
+/*===============================================================================================*/
+void hd44780_sim_init(struct hd44780_sim *sim, int rows, int cols) {
+  memset(sim, 0, sizeof(*sim));
+  sim->rows = rows;
+  sim->cols = cols;
+  sim->width = 4;
+  memset(sim->ddram, ' ', sizeof(sim->ddram));
+  sim->increment = 1;
+}
+
+void hd44780_sim_reset_stats(struct hd44780_sim *sim) {
+  int mode;
+  sim->bytes = 0;
+  sim->commands = 0;
+  sim->data = 0;
+  sim->strobes = 0;
+  for (mode = 0; mode < HD44780_MODES; mode++) {
+    sim->busNs[mode] = 0;
+    sim->cpuNs[mode] = 0;
+  }
+}
+
+/*===============================================================================================*/
+/*
+ * next DDRAM address: 0x00-0x27 is the first line, 0x40-0x67 the second
+ */
+static int ddram_step(const int ac, const int increment) {
+  int row = ac >= 0x40;
+  int col = ac & 0x3F;
+  if (increment) {
+    if (++col >= HD44780_LINE_LEN) {
+      col = 0;
+      row = !row;
+    }
+  }
+  else {
+    if (--col < 0) {
+      col = HD44780_LINE_LEN - 1;
+      row = !row;
+    }
+  }
+  return (row ? 0x40 : 0x00) + col;
+}
+
+/*
+ * A byte takes two strobes on a 4 bit bus, each followed by the fixed
+ * delay, or one on an 8 bit bus. Busy flag reads take as many strobes,
+ * the worker sleeps between two of them. The hrtimer writes the nibbles
+ * of a byte in one interrupt and sleeps the fixed delay after them.
+ *
+ * The CPU is busy during the strobes, the reads, the udelay() of data
+ * bytes in the fixed mode and the interrupts of the timer; the sleeps
+ * leave it to other tasks.
+ */
+static void account(struct hd44780_sim *sim, const int rs, const uint64_t execNs) {
+  const uint64_t fixedNs = rs ? FIXED_DATA_NS : FIXED_CMD_NS;
+  const uint64_t pollNs = (sim->width == 8) ? BUSY_POLL8_NS : BUSY_POLL_NS;
+  const uint64_t cycleNs = pollNs + BUSY_SLEEP_NS;
+  uint64_t polls = (execNs + BUSY_SLEEP_NS + cycleNs - 1) / cycleNs;
+  uint64_t strobeNs = ENABLE_NS;
+
+  if (polls == 0) {
+    polls = 1;
+  }
+  sim->bytes++;
+  if (rs) {
+    sim->data++;
+  }
+  else {
+    sim->commands++;
+  }
+  if (sim->width == 8) {
+    sim->strobes += 1;
+    sim->busNs[HD44780_FIXED] += ENABLE_NS + fixedNs;
+  }
+  else {
+    sim->strobes += 2;
+    strobeNs = 2 * ENABLE_NS + BUSY_NIBBLE_NS;
+    sim->busNs[HD44780_FIXED] += 2 * (ENABLE_NS + fixedNs);
+  }
+  sim->cpuNs[HD44780_FIXED] += (sim->width == 8) ? ENABLE_NS : 2 * ENABLE_NS;
+  if (rs) {
+    sim->cpuNs[HD44780_FIXED] += (sim->width == 8) ? fixedNs : 2 * fixedNs;
+  }
+  sim->busNs[HD44780_BUSY] += strobeNs + polls * pollNs + (polls - 1) * BUSY_SLEEP_NS;
+  sim->cpuNs[HD44780_BUSY] += strobeNs + polls * pollNs;
+  sim->busNs[HD44780_TIMER] += strobeNs + (rs ? TIMER_DATA_NS : TIMER_CMD_NS);
+  sim->cpuNs[HD44780_TIMER] += strobeNs + TIMER_IRQ_NS;
+}
+
+static uint64_t command(struct hd44780_sim *sim, const unsigned char byte) {
+  if (byte & 0x80) {
+    /* set DDRAM address */
+    sim->ac = byte & 0x7F;
+    sim->cgramMode = 0;
+  }
+  else if (byte & 0x40) {
+    /* set CGRAM address */
+    sim->ac = byte & 0x3F;
+    sim->cgramMode = 1;
+  }
+  else if (byte & 0x20) {
+    /* function set, the width is given by sim->width, lines are not modelled */
+  }
+  else if (byte & 0x10) {
+    /* cursor or display shift */
+    const int right = (byte & 0x04) != 0;
+    if (byte & 0x08) {
+      sim->shift = (sim->shift + (right ? HD44780_LINE_LEN - 1 : 1)) % HD44780_LINE_LEN;
+    }
+    else {
+      sim->ac = ddram_step(sim->ac, right);
+    }
+  }
+  else if (byte & 0x08) {
+    sim->displayOn = (byte & 0x04) != 0;
+    sim->cursorOn = (byte & 0x02) != 0;
+  }
+  else if (byte & 0x04) {
+    sim->increment = (byte & 0x02) != 0;
+  }
+  else if (byte & 0x02) {
+    sim->ac = 0;
+    sim->shift = 0;
+    sim->cgramMode = 0;
+    return EXEC_HOME_NS;
+  }
+  else if (byte & 0x01) {
+    memset(sim->ddram, ' ', sizeof(sim->ddram));
+    sim->ac = 0;
+    sim->shift = 0;
+    sim->increment = 1;
+    sim->cgramMode = 0;
+    return EXEC_CLEAR_NS;
+  }
+  return EXEC_CMD_NS;
+}
+
+static void data(struct hd44780_sim *sim, const unsigned char byte) {
+  if (sim->cgramMode) {
+    sim->cgram[sim->ac & 0x3F] = byte;
+    sim->ac = (sim->ac + (sim->increment ? 1 : -1)) & 0x3F;
+  }
+  else {
+    sim->ddram[sim->ac >= 0x40][(sim->ac & 0x3F) % HD44780_LINE_LEN] = byte;
+    sim->ac = ddram_step(sim->ac, sim->increment);
+  }
+}
+
+void hd44780_sim_write(void *ctx, int rs, unsigned char byte) {
+  struct hd44780_sim *sim = ctx;
+  if (rs) {
+    data(sim, byte);
+    account(sim, rs, EXEC_DATA_NS);
+  }
+  else {
+    account(sim, rs, command(sim, byte));
+  }
+}
+
+void hd44780_sim_pcf8574(struct hd44780_sim *sim, unsigned char out) {
+  /* P0 RS, P2 EN, P4..P7 D4..D7 */
+  if ((sim->pins & 0x04) && !(out & 0x04)) {
+    if (sim->nibbles == 0) {
+      sim->high = sim->pins & 0xF0;
+      sim->nibbles = 1;
+    }
+    else {
+      sim->nibbles = 0;
+      hd44780_sim_write(sim, sim->pins & 0x01, sim->high | (sim->pins >> 4));
+    }
+  }
+  sim->pins = out;
+}
+
+/*===============================================================================================*/
+void hd44780_sim_visible(const struct hd44780_sim *sim, int row, char *out) {
+  const int start = (row / 2) * sim->cols;
+  int col;
+  for (col = 0; col < sim->cols; col++) {
+    out[col] = sim->ddram[row % 2][(sim->shift + start + col) % HD44780_LINE_LEN];
+  }
+  out[sim->cols] = '\0';
+}
+
+void hd44780_sim_cursor(const struct hd44780_sim *sim, int *row, int *col) {
+  int offset = ((sim->ac & 0x3F) - sim->shift + HD44780_LINE_LEN) % HD44780_LINE_LEN;
+  *row = (sim->ac >= 0x40) + 1;
+  if (sim->rows > 2 && offset >= sim->cols) {
+    *row += 2;
+    offset -= sim->cols;
+  }
+  *col = offset + 1;
+}
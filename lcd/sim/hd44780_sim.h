@@ -0,0 +1,72 @@
+#ifndef HD44780_SIM_H_
+#define HD44780_SIM_H_
+/*
+ * Simulated HD44780 controller for host builds of the rpilcd core.
+ * Models DDRAM, CGRAM, the address counter, display shift and the
+ * execution time of every instruction, and accounts the time the driver
+ * spends on the bus in each of its timing modes.
+ */
+#include <stdint.h>
+
+#define HD44780_LINE_LEN  40      /* DDRAM bytes per line */
+#define HD44780_ROWS      2
+
+/**
+ * Driver timing modes, bus time is accounted for all of them at once
+ */
+enum hd44780_mode {
+  HD44780_FIXED,          /* fixed udelay/usleep_range after each nibble */
+  HD44780_BUSY,           /* busy flag polling (busyflag=1) */
+  HD44780_TIMER,          /* hrtimer, fixed wait after each byte (txtimer=1) */
+  HD44780_MODES
+};
+
+struct hd44780_sim {
+  /* panel: lines 3 and 4 of a 4 line panel continue lines 1 and 2 in DDRAM */
+  int rows;
+  int cols;
+  int width;              /* data lines of the driver, 4 or 8 */
+
+  /* controller state */
+  unsigned char ddram[HD44780_ROWS][HD44780_LINE_LEN];
+  unsigned char cgram[64];
+  int cgramMode;          /* last address set was a CGRAM address */
+  int ac;                 /* address counter */
+  int increment;          /* entry mode I/D */
+  int shift;              /* display shift, in cells */
+  int displayOn;
+  int cursorOn;
+
+  /* 4 bit interface behind a PCF8574, see hd44780_sim_pcf8574() */
+  unsigned char pins;     /* last expander output */
+  int nibbles;            /* nibbles latched of the current byte */
+  unsigned char high;     /* the first of them */
+
+  /* statistics */
+  unsigned long bytes;
+  unsigned long commands;
+  unsigned long data;
+  unsigned long strobes;  /* EN pulses writing bytes, two per byte on 4 lines */
+  uint64_t busNs[HD44780_MODES];
+  uint64_t cpuNs[HD44780_MODES];  /* of it, spent spinning or in the timer */
+};
+
+void hd44780_sim_init(struct hd44780_sim *sim, int rows, int cols);
+void hd44780_sim_reset_stats(struct hd44780_sim *sim);
+
+/* rpilcd_bus_t write() callback, ctx is the struct hd44780_sim */
+void hd44780_sim_write(void *ctx, int rs, unsigned char byte);
+
+/*
+ * one write to a PCF8574 backpack wired as in rpilcd_pcf8574.h: EN going
+ * low latches D4..D7, two nibbles make a byte for hd44780_sim_write()
+ */
+void hd44780_sim_pcf8574(struct hd44780_sim *sim, unsigned char out);
+
+/* the visible cells of a row starting from 0, out must hold cols + 1 bytes */
+void hd44780_sim_visible(const struct hd44780_sim *sim, int row, char *out);
+
+/* cursor position on the glass, row and column start from 1 */
+void hd44780_sim_cursor(const struct hd44780_sim *sim, int *row, int *col);
+
+#endif //HD44780_SIM_H_
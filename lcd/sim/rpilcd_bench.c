@@ -0,0 +1,689 @@
+// Host benchmark of the rpilcd driver logic against a simulated HD44780.
+//
+// make -C lcd bench && lcd/rpilcd_bench
+//
+// Runs typical workloads through rpilcd_core.c with the protocols a
+// client can use and prints, per logical screen update: syscalls, bytes
+// on the bus, commands, and simulated bus time for each timing mode of
+// the driver. The workloads fill every row and column of the panel, the
+// frame ioctl only on panels it can hold. Every update is checked
+// against the simulated glass. The last tables compare the 4 and 8 bit
+// buses with frame updates (the map on bigger panels), the CPU time
+// each timing mode takes from the other tasks, and the I2C transactions
+// of a PCF8574 backpack per frame. The marquee table scrolls an alert
+// with the display shift and with the repaints.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../rpilcd_core.h"
+#include "../rpilcd_pcf8574.h"
+#include "hd44780_sim.h"
+
+enum protocol {
+  REPAINT,        // escape writes, clear + full repaint per write (old driver)
+  WRITES,         // escape writes, diff flush after each write
+  COALESCED,      // escape writes, one diff flush per update (busy worker)
+  FRAME,          // RPILCD_IOC_SET_FRAME
+  MAP,            // cells written in the mmap()ed buffer, RPILCD_IOC_FLUSH_MAP
+  STREAM,         // the whole update in one write() with control codes
+  CHUNKED,        // the same bytes in small pieces, one flush at the end
+  PROTOCOLS
+};
+
+static const char *protocol_names[PROTOCOLS] = {
+  "repaint", "writes", "coalesced", "frame", "map", "stream", "chunked"
+};
+
+// piece size of CHUNKED, small enough to cut the sequences
+#define CHUNK 5
+
+struct bench {
+  struct hd44780_sim sim;
+  struct rpilcd_core_t core;
+  struct rpilcd_map map;          // what the application sees after mmap()
+  enum protocol protocol;
+  unsigned long updates;
+  unsigned long syscalls;
+  unsigned long mismatches;
+  struct rpilcd_pcf8574_t *pcf;   // bytes go through a PCF8574 backpack when set
+  uint64_t i2cNs;
+};
+
+static const struct rpilcd_bus_t sim_bus = {
+  .write = hd44780_sim_write,
+};
+
+// the driver side of rpilcd_i2c_transport in device_file.c
+static void pcf_write(void *ctx, int rs, unsigned char byte) {
+  struct bench *b = ctx;
+  rpilcd_pcf8574_byte(b->pcf, rs, byte);
+}
+
+static const struct rpilcd_bus_t pcf_bus = {
+  .write = pcf_write,
+};
+
+// ---------------------------------------------------
+// DRIVER PATHS
+// ---------------------------------------------------
+static void bench_init(struct bench *b, enum protocol protocol, int rows, int cols) {
+  memset(b, 0, sizeof(*b));
+  hd44780_sim_init(&b->sim, rows, cols);
+  rpilcd_core_init(&b->core, rows, cols, &sim_bus, &b->sim);
+  // state after rpilcd_init_display: cleared, cursor home
+  rpilcd_core_reset_shadow(&b->core);
+  b->protocol = protocol;
+  b->map.rows = rows;
+  b->map.cols = cols;
+  memset(b->map.cells, ' ', sizeof(b->map.cells));
+}
+
+static void send_cursor(struct bench *b, int row, int col) {
+  const int start = ((row - 1) / 2) * b->core.cols;
+  hd44780_sim_write(&b->sim, 0, 0x80 + ((row - 1) % 2 ? 0x40 : 0) + start + col - 1);
+}
+
+// what rpilcd_write did before the shadow frame: clear and resend all
+static void repaint(struct bench *b) {
+  const char *p;
+  int row;
+  hd44780_sim_write(&b->sim, 0, 0x01);
+  for (row = 0; row < b->core.rows; row++) {
+    send_cursor(b, row + 1, 1);
+    for (p = b->core.lines[row]; *p != '\0'; p++) {
+      hd44780_sim_write(&b->sim, 1, *p);
+    }
+  }
+  send_cursor(b, b->core.curRow, b->core.curCol);
+}
+
+static void flush(struct bench *b) {
+  if (b->protocol == REPAINT) {
+    repaint(b);
+  }
+  else {
+    rpilcd_core_flush(&b->core);
+  }
+  if (b->pcf != NULL) {
+    rpilcd_pcf8574_flush(b->pcf);
+  }
+}
+
+// one write() on /dev/rpilcdN
+static void sys_write(struct bench *b, const char *buf, size_t count) {
+  b->syscalls++;
+  rpilcd_core_apply_write(&b->core, buf, count);
+  if (b->protocol != COALESCED) {
+    flush(b);
+  }
+}
+
+// compare the simulated glass with the model, custom characters with
+// the glyph cache
+static void check(struct bench *b) {
+  char glass[MAX_LEN+1];
+  char expected[MAX_LEN+1];
+  int row, col;
+
+  for (row = 0; row < b->core.rows; row++) {
+    snprintf(expected, sizeof(expected), "%-*s", b->core.cols, b->core.lines[row]);
+    hd44780_sim_visible(&b->sim, row, glass);
+    if (strcmp(glass, expected) != 0) {
+      b->mismatches++;
+      return;
+    }
+    for (col = 0; col < b->core.cols; col++) {
+      const unsigned char code = glass[col];
+      if (code >= GLYPH_BASE && code < GLYPH_BASE + CGRAM_SLOTS &&
+          memcmp(&b->sim.cgram[(code & 7) * GLYPH_ROWS], b->core.glyphs[code & 7].bitmap,
+                 GLYPH_ROWS) != 0) {
+        b->mismatches++;
+        return;
+      }
+    }
+  }
+  hd44780_sim_cursor(&b->sim, &row, &col);
+  if (row != b->core.curRow || col != b->core.curCol) {
+    b->mismatches++;
+  }
+}
+
+// RPILCD_IOC_FLUSH_MAP, what rpilcd_apply_map does in the worker
+static void flush_map(struct bench *b) {
+  int row;
+  for (row = 0; row < b->core.rows; row++) {
+    if (b->map.dirty[row] != 0) {
+      rpilcd_core_apply_cells(&b->core, row + 1, b->map.dirty[row], b->map.cells[row]);
+      b->map.dirty[row] = 0;
+    }
+  }
+  if (b->map.row != 0) {
+    rpilcd_core_set_cursor(&b->core, b->map.row, b->map.col);
+  }
+  b->syscalls++;
+  flush(b);
+}
+
+// the application writes the changed cells and marks them dirty
+static void write_map(struct bench *b, int row, const char *line) {
+  int col;
+  for (col = 0; col < b->core.cols; col++) {
+    char c = col < (int)strnlen(line, b->core.cols) ? line[col] : ' ';
+    if (b->map.cells[row][col] != c) {
+      b->map.cells[row][col] = c;
+      b->map.dirty[row] |= 1u << col;
+    }
+  }
+}
+
+// text of one logical screen update, a line per row of the panel
+typedef char screen_t[MAX_ROWS][MAX_LEN + 1];
+
+// the last row holding text, the empty ones below it are not sent
+static int last_row(const struct bench *b, screen_t lines) {
+  int row = b->core.rows;
+  while (row > 1 && lines[row - 1][0] == '\0') {
+    row--;
+  }
+  return row;
+}
+
+// cursor after the last character written, as print_to_lcd_device leaves it
+static void end_cursor(const struct bench *b, screen_t lines, int *row, int *col) {
+  *row = last_row(b, lines);
+  *col = strnlen(lines[*row - 1], b->core.cols);
+  if (*col < 1) {
+    *col = 1;
+  }
+}
+
+// RPILCD_IOC_SET_FRAME only holds 2 lines of 16, bigger panels use the map
+static enum protocol frame_protocol(int rows, int cols) {
+  return (rows <= RPILCD_ROWS && cols <= RPILCD_COLS) ? FRAME : MAP;
+}
+
+// one logical screen update, the way print_to_lcd_device in dht11_back.c
+// does it on a 2 line panel and the same for every row of a bigger one
+static void update(struct bench *b, screen_t lines) {
+  const int last = last_row(b, lines);
+  int row, col, i;
+  end_cursor(b, lines, &row, &col);
+
+  if (b->protocol == MAP) {
+    for (i = 0; i < b->core.rows; i++) {
+      write_map(b, i, lines[i]);
+    }
+    b->map.row = row;
+    b->map.col = col;
+    flush_map(b);
+  }
+  else if (b->protocol == FRAME) {
+    struct rpilcd_frame frame;
+    memset(&frame, 0, sizeof(frame));
+    memcpy(frame.line1, lines[0], strnlen(lines[0], RPILCD_COLS));
+    memcpy(frame.line2, lines[1], strnlen(lines[1], RPILCD_COLS));
+    frame.row = row;
+    frame.col = col;
+    b->syscalls++;
+    rpilcd_core_apply_frame(&b->core, &frame);
+    flush(b);
+  }
+  else if (b->protocol == STREAM || b->protocol == CHUNKED) {
+    // home, each line and erase the rest of it
+    char buf[MAX_ROWS * (MAX_LEN + 8) + 16];
+    size_t len = 0, j;
+    len += snprintf(buf + len, sizeof(buf) - len, "\033[H");
+    for (i = 0; i < b->core.rows; i++) {
+      len += snprintf(buf + len, sizeof(buf) - len, "%s%s\033[K", i > 0 ? "\n" : "", lines[i]);
+    }
+    len += snprintf(buf + len, sizeof(buf) - len, "\033[%d;%dH", row, col);
+    if (b->protocol == STREAM) {
+      sys_write(b, buf, len);
+    }
+    else {
+      // what the driver does with the chunks of a long write()
+      for (j = 0; j < len; j += CHUNK) {
+        rpilcd_core_apply_write(&b->core, buf + j, len - j < CHUNK ? len - j : CHUNK);
+      }
+      b->syscalls++;
+      flush(b);
+    }
+  }
+  else {
+    sys_write(b, "\\c", 3);
+    for (i = 0; i < last; i++) {
+      if (i > 0) {
+        sys_write(b, "\\n", 3);
+      }
+      sys_write(b, lines[i], strlen(lines[i]));
+    }
+    if (b->protocol == COALESCED) {
+      flush(b);
+    }
+  }
+  b->updates++;
+  check(b);
+}
+
+// ---------------------------------------------------
+// WORKLOADS
+// ---------------------------------------------------
+
+// dashboard clock: only the seconds change most of the time, the lines
+// below the second stay as they are
+static void clock_tick(struct bench *b, int step) {
+  screen_t lines;
+  int s = 12 * 3600 + step;
+  memset(lines, 0, sizeof(lines));
+  snprintf(lines[0], sizeof(lines[0]), "Czas: %02d:%02d:%02d", s / 3600 % 24, s / 60 % 60, s % 60);
+  snprintf(lines[1], sizeof(lines[1]), "Wil: %d,Temp: %d", 45, (23 + step / 30) % 100);
+  if (b->core.rows > 2) {
+    snprintf(lines[2], sizeof(lines[2]), "Min: 21 Max: 25");
+    snprintf(lines[3], sizeof(lines[3]), "Serwo: 90");
+  }
+  update(b, lines);
+}
+
+// every cell of the panel changes on every update
+static void full_rewrite(struct bench *b, int step) {
+  screen_t lines;
+  int row, col;
+  memset(lines, 0, sizeof(lines));
+  for (row = 0; row < b->core.rows; row++) {
+    for (col = 0; col < b->core.cols; col++) {
+      const int cell = row * b->core.cols + col;
+      lines[row][col] = (step % 2) ? 'A' + cell % 26 : '0' + cell % 10;
+    }
+  }
+  update(b, lines);
+}
+
+// a line typed one character at a time, then deleted
+static void typing(struct bench *b, int step) {
+  static const char text[] = "Hello, world!";
+  const int len = sizeof(text) - 1;
+  int n = step % (2 * len);
+  screen_t lines;
+  if (n > len) {
+    n = 2 * len - n;
+  }
+  memset(lines, 0, sizeof(lines));
+  snprintf(lines[0], sizeof(lines[0]), "%.*s", n, text);
+  update(b, lines);
+}
+
+struct workload {
+  const char *name;
+  void (*step)(struct bench *b, int step);
+  int steps;
+};
+
+static const struct workload workloads[] = {
+  { "clock tick", clock_tick, 600 },
+  { "full rewrite", full_rewrite, 100 },
+  { "typing", typing, 260 },
+};
+
+// ---------------------------------------------------
+// BAR GRAPHS
+// ---------------------------------------------------
+
+// humidity history scrolling through the graph, a random walk
+static void bars_update(struct bench *b, int step, int rows, int uncached) {
+  const int cols = b->core.cols;
+  static unsigned char history[MAX_LEN];
+  static unsigned int seed = 1;
+  struct rpilcd_bars bars;
+  int i;
+
+  if (step == 0) {
+    seed = 1;
+    memset(history, 50, sizeof(history));
+  }
+  memmove(history, history + 1, cols - 1);
+  seed = seed * 1103515245 + 12345;
+  history[cols - 1] = (history[cols - 2] + (int)((seed >> 16) % 9) - 4) % 101;
+
+  if (uncached) {
+    // no resident check: every glyph is sent again with each graph
+    for (i = 0; i < CGRAM_SLOTS; i++) {
+      b->core.glyphs[i].upload = b->core.glyphs[i].valid;
+    }
+  }
+  memset(&bars, 0, sizeof(bars));
+  bars.row = b->core.rows;
+  bars.col = 1;
+  bars.rows = rows;
+  bars.count = cols;
+  bars.max = 100;
+  memcpy(bars.values, history, cols);
+  if (rows == 1 && step == 0) {
+    rpilcd_core_apply_write(&b->core, "Wilgotnosc 24h", 14);
+  }
+  b->syscalls++;
+  rpilcd_core_apply_bars(&b->core, &bars);
+  rpilcd_core_flush(&b->core);
+  b->updates++;
+  check(b);
+}
+
+// panel geometries the workloads run on
+static const int panels[][2] = { { 2, 16 }, { 4, 20 } };
+#define PANELS (int)(sizeof(panels) / sizeof(panels[0]))
+
+static void run_bars(void) {
+  static const char *names[2] = { "sparkline", "full height" };
+  int panel, full, uncached, step;
+
+  printf("\n%-5s %-13s %-10s %8s %9s %9s %12s %12s %6s\n", "panel", "graph", "cgram", "updates",
+         "bytes/upd", "glyph/upd", "fixed ms/upd", "busy ms/upd", "errors");
+  for (panel = 0; panel < PANELS; panel++) {
+    for (full = 0; full <= 1; full++) {
+      for (uncached = 0; uncached <= 1; uncached++) {
+        struct bench *b = malloc(sizeof(*b));
+        char size[8];
+        double n;
+
+        bench_init(b, FRAME, panels[panel][0], panels[panel][1]);
+        for (step = 0; step < 300; step++) {
+          bars_update(b, step, full ? b->core.rows : 1, uncached);
+        }
+        n = b->updates;
+        snprintf(size, sizeof(size), "%dx%d", b->core.cols, b->core.rows);
+        printf("%-5s %-13s %-10s %8lu %9.2f %9.2f %12.3f %12.3f %6lu\n",
+               size, names[full], uncached ? "uncached" : "cached", b->updates,
+               b->sim.bytes / n, b->core.glyphUploads / n,
+               b->sim.busNs[HD44780_FIXED] / n / 1e6, b->sim.busNs[HD44780_BUSY] / n / 1e6,
+               b->mismatches);
+        free(b);
+      }
+    }
+  }
+}
+
+// ---------------------------------------------------
+// BUS WIDTH
+// ---------------------------------------------------
+
+// bus time per frame with D4..D7 and with D0..D7 wired (buswidth=8)
+static void run_widths(void) {
+  static const int widths[2] = { 4, 8 };
+  size_t w;
+  int panel, i, step;
+
+  printf("\n%-5s %-13s %-5s %8s %9s %11s %12s %12s %6s\n", "panel", "workload", "bus", "updates",
+         "bytes/upd", "strobes/upd", "fixed ms/upd", "busy ms/upd", "errors");
+  for (panel = 0; panel < PANELS; panel++) {
+    for (w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+      for (i = 0; i < 2; i++) {
+        struct bench *b = malloc(sizeof(*b));
+        char size[8], bus[8];
+        double n;
+
+        bench_init(b, frame_protocol(panels[panel][0], panels[panel][1]), panels[panel][0],
+                   panels[panel][1]);
+        b->sim.width = widths[i];
+        for (step = 0; step < workloads[w].steps; step++) {
+          workloads[w].step(b, step);
+        }
+        n = b->updates;
+        snprintf(size, sizeof(size), "%dx%d", b->core.cols, b->core.rows);
+        snprintf(bus, sizeof(bus), "%d bit", widths[i]);
+        printf("%-5s %-13s %-5s %8lu %9.2f %11.2f %12.3f %12.3f %6lu\n",
+               size, workloads[w].name, bus, b->updates, b->sim.bytes / n, b->sim.strobes / n,
+               b->sim.busNs[HD44780_FIXED] / n / 1e6, b->sim.busNs[HD44780_BUSY] / n / 1e6,
+               b->mismatches);
+        free(b);
+      }
+    }
+  }
+}
+
+// ---------------------------------------------------
+// CPU LOAD
+// ---------------------------------------------------
+
+// bus time and CPU time per frame in each timing mode: what is not spent
+// spinning is left to the other tasks, rpilcd_load measures it on a Pi
+static void run_load(void) {
+  static const char *mode_names[HD44780_MODES] = { "fixed", "busy", "timer" };
+  size_t w;
+  int panel, mode, step;
+
+  printf("\n%-5s %-13s %-6s %8s %9s %11s %11s %8s %6s\n", "panel", "workload", "mode",
+         "updates", "bytes/upd", "bus ms/upd", "cpu ms/upd", "cpu %", "errors");
+  for (panel = 0; panel < PANELS; panel++) {
+    for (w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+      struct bench *b = malloc(sizeof(*b));
+      char size[8];
+      double n;
+
+      bench_init(b, frame_protocol(panels[panel][0], panels[panel][1]), panels[panel][0],
+                 panels[panel][1]);
+      for (step = 0; step < workloads[w].steps; step++) {
+        workloads[w].step(b, step);
+      }
+      n = b->updates;
+      snprintf(size, sizeof(size), "%dx%d", b->core.cols, b->core.rows);
+      for (mode = 0; mode < HD44780_MODES; mode++) {
+        printf("%-5s %-13s %-6s %8lu %9.2f %11.3f %11.3f %8.1f %6lu\n",
+               size, workloads[w].name, mode_names[mode], b->updates, b->sim.bytes / n,
+               b->sim.busNs[mode] / n / 1e6, b->sim.cpuNs[mode] / n / 1e6,
+               b->sim.busNs[mode] > 0 ? 100.0 * b->sim.cpuNs[mode] / b->sim.busNs[mode] : 0.0,
+               b->mismatches);
+      }
+      free(b);
+    }
+  }
+}
+
+// ---------------------------------------------------
+// I2C BACKPACK
+// ---------------------------------------------------
+
+#define I2C_CLOCK_NS  10000     // 100 kHz, the limit of the PCF8574
+
+// the message as i2c_transfer would put it on the wire, decoded by the
+// simulated backpack; an address byte per transaction, 9 clocks a byte,
+// about one more for start and stop
+static int sim_xfer(void *ctx, const unsigned char *buf, unsigned int len, unsigned int waitUs) {
+  struct bench *b = ctx;
+  unsigned int i;
+  for (i = 0; i < len; i++) {
+    hd44780_sim_pcf8574(&b->sim, buf[i]);
+  }
+  b->i2cNs += (uint64_t)((len + 1) * 9 + 1) * I2C_CLOCK_NS + waitUs * 1000ull;
+  return len > 0 ? 1 : 0;
+}
+
+// transactions per frame with one write per pin change in its own
+// transaction, SMBus block writes (a command byte and 32 data bytes, the
+// fallback on adapters without plain I2C) and whole messages
+static void run_i2c(void) {
+  static const char *names[3] = { "per write", "smbus", "batched" };
+  static const unsigned int batches[3] = { 1, 33, PCF8574_BATCH };
+  size_t w;
+  int panel, i, step;
+
+  printf("\n%-5s %-13s %-10s %8s %9s %10s %10s %11s %6s\n", "panel", "workload", "i2c",
+         "updates", "bytes/upd", "xfers/upd", "wire B/upd", "i2c ms/upd", "errors");
+  for (panel = 0; panel < PANELS; panel++) {
+    for (w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+      for (i = 0; i < 3; i++) {
+        struct bench *b = malloc(sizeof(*b));
+        struct rpilcd_pcf8574_t *pcf = malloc(sizeof(*pcf));
+        char size[8];
+        double n;
+
+        bench_init(b, frame_protocol(panels[panel][0], panels[panel][1]), panels[panel][0],
+                   panels[panel][1]);
+        rpilcd_core_init(&b->core, b->core.rows, b->core.cols, &pcf_bus, b);
+        rpilcd_core_reset_shadow(&b->core);
+        rpilcd_pcf8574_init(pcf, batches[i], sim_xfer, b);
+        b->pcf = pcf;
+        for (step = 0; step < workloads[w].steps; step++) {
+          workloads[w].step(b, step);
+        }
+        n = b->updates;
+        snprintf(size, sizeof(size), "%dx%d", b->core.cols, b->core.rows);
+        printf("%-5s %-13s %-10s %8lu %9.2f %10.2f %10.2f %11.3f %6lu\n",
+               size, workloads[w].name, names[i], b->updates, b->sim.bytes / n,
+               pcf->transfers / n, (pcf->bytes + pcf->transfers) / n, b->i2cNs / n / 1e6,
+               b->mismatches + pcf->errors);
+        free(pcf);
+        free(b);
+      }
+    }
+  }
+}
+
+// ---------------------------------------------------
+// MARQUEE
+// ---------------------------------------------------
+
+static const char *marquee_text[2] = {
+  "ALARM: wilgotnosc 85%, sprawdz okna",
+  "Temp: 23C  Wil: 85%  czujnik 1 ",
+};
+
+// the cells of a line scrolled by shift, as the glass should show them
+static void marquee_window(const struct bench *b, int line, int shift, char *out) {
+  const size_t len = strlen(marquee_text[line]);
+  int col;
+  for (col = 0; col < b->core.cols; col++) {
+    const int i = (shift + col) % RPILCD_MARQUEE_LEN;
+    out[col] = i < (int)len ? marquee_text[line][i] : ' ';
+  }
+  out[b->core.cols] = '\0';
+}
+
+static void check_marquee(struct bench *b, int shift) {
+  char glass[MAX_LEN+1];
+  char expected[MAX_LEN+1];
+  int row;
+  for (row = 0; row < b->core.rows; row++) {
+    marquee_window(b, row, shift, expected);
+    hd44780_sim_visible(&b->sim, row, glass);
+    if (strcmp(glass, expected) != 0) {
+      b->mismatches++;
+      return;
+    }
+  }
+}
+
+// one scroll step per update: the old driver clearing and repainting,
+// the scrolled lines as a frame drawn by the diff flush, or
+// RPILCD_IOC_MARQUEE loading the text once and shifting the display.
+// The dashboard behind the marquee has to be back once it stops.
+static void run_marquee(void) {
+  static const char *names[3] = { "repaint", "frame", "shift" };
+  const int steps = 2 * RPILCD_MARQUEE_LEN;
+  int mode, step;
+
+  printf("\n%-5s %-13s %-10s %8s %9s %9s %12s %12s %6s\n", "panel", "workload", "scroll",
+         "steps", "bytes/upd", "cmds/upd", "fixed ms/upd", "busy ms/upd", "errors");
+  for (mode = 0; mode < 3; mode++) {
+    struct bench *b = malloc(sizeof(*b));
+    double n;
+
+    bench_init(b, mode == 0 ? REPAINT : FRAME, 2, 16);
+    clock_tick(b, 0);
+    hd44780_sim_reset_stats(&b->sim);
+    b->updates = 0;
+    if (mode == 2) {
+      struct rpilcd_marquee marquee;
+      memset(&marquee, 0, sizeof(marquee));
+      strncpy(marquee.line1, marquee_text[0], RPILCD_MARQUEE_LEN);
+      strncpy(marquee.line2, marquee_text[1], RPILCD_MARQUEE_LEN);
+      marquee.period_ms = 300;
+      marquee.steps = steps;
+      rpilcd_core_apply_marquee(&b->core, &marquee);
+      flush(b);
+      check_marquee(b, 0);
+      for (step = 1; step <= steps; step++) {
+        // the sensor loop goes on behind the marquee, the glass can't
+        // match its lines meanwhile
+        if (step % 7 == 0) {
+          const unsigned long mismatches = b->mismatches;
+          clock_tick(b, step);
+          b->updates--;
+          b->mismatches = mismatches;
+        }
+        if (rpilcd_core_marquee_step(&b->core)) {
+          check_marquee(b, step);
+        }
+        else {
+          flush(b);
+        }
+        b->updates++;
+      }
+    }
+    else {
+      for (step = 1; step <= steps; step++) {
+        screen_t lines;
+        memset(lines, 0, sizeof(lines));
+        marquee_window(b, 0, step, lines[0]);
+        marquee_window(b, 1, step, lines[1]);
+        update(b, lines);
+      }
+      clock_tick(b, steps);
+      b->updates--;
+    }
+    check(b);
+    n = b->updates;
+    printf("%-5s %-13s %-10s %8lu %9.2f %9.2f %12.3f %12.3f %6lu\n",
+           "16x2", "alert scroll", names[mode], b->updates, b->sim.bytes / n,
+           b->sim.commands / n, b->sim.busNs[HD44780_FIXED] / n / 1e6,
+           b->sim.busNs[HD44780_BUSY] / n / 1e6, b->mismatches);
+    free(b);
+  }
+}
+
+// ---------------------------------------------------
+// MAIN
+// ---------------------------------------------------
+int main(int argc, char *argv[]) {
+  size_t w;
+  int panel, p;
+
+  printf("%-5s %-13s %-10s %8s %9s %9s %9s %12s %12s %6s\n", "panel", "workload", "protocol",
+         "updates", "sys/upd", "bytes/upd", "cmds/upd", "fixed ms/upd", "busy ms/upd", "errors");
+
+  for (panel = 0; panel < PANELS; panel++) {
+    for (w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+      for (p = 0; p < PROTOCOLS; p++) {
+        struct bench *b;
+        if (p == FRAME && frame_protocol(panels[panel][0], panels[panel][1]) != FRAME) {
+          continue;
+        }
+        b = malloc(sizeof(*b));
+        char size[8];
+        double n;
+        int step;
+
+        bench_init(b, p, panels[panel][0], panels[panel][1]);
+        hd44780_sim_reset_stats(&b->sim);
+        for (step = 0; step < workloads[w].steps; step++) {
+          workloads[w].step(b, step);
+        }
+
+        n = b->updates;
+        snprintf(size, sizeof(size), "%dx%d", b->core.cols, b->core.rows);
+        printf("%-5s %-13s %-10s %8lu %9.2f %9.2f %9.2f %12.3f %12.3f %6lu\n",
+               size, workloads[w].name, protocol_names[p], b->updates,
+               b->syscalls / n, b->sim.bytes / n, b->sim.commands / n,
+               b->sim.busNs[HD44780_FIXED] / n / 1e6, b->sim.busNs[HD44780_BUSY] / n / 1e6,
+               b->mismatches);
+        free(b);
+      }
+    }
+  }
+  run_bars();
+  run_widths();
+  run_load();
+  run_i2c();
+  run_marquee();
+  return 0;
+}
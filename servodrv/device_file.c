@@ -0,0 +1,201 @@
+#include "device_file.h"
+
+#include <linux/module.h>
+#include <linux/init.h>
+
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/device.h>
+#include <linux/mutex.h>
+#include <linux/pwm.h>
+
+/**
+ * PWM channel driving the servo (GPIO 18 / PWM0 on the Pi)
+ */
+static int pwm = 0;
+module_param(pwm, int, S_IRUGO);
+MODULE_PARM_DESC(pwm, "PWM channel connected to the servo");
+
+/**
+ * Device driver name and its corresponding class name.
+ */
+#define DEVICE_NAME     "rpiservo"
+#define CLASS_NAME      "rpiservo_class"
+
+/**
+ * from SG90 servo specification, same mapping as dht11/servo.c but in
+ * microseconds since the kernel has no floating point
+ */
+#define SERVO_PERIOD_US     20000
+#define MIN_PULSE_WIDTH_US  500
+#define MAX_PULSE_WIDTH_US  2500
+
+#define MIN_TEMP 0
+#define MAX_TEMP 50
+
+/**
+ * Global variable for the device class
+ */
+static struct class* gpst_rpiservo_class = (struct class *)NULL;
+static struct device* gpst_rpiservo_device = (struct device *)NULL;
+static struct pwm_device* gpst_pwm = (struct pwm_device *)NULL;
+
+/**
+ * Last pulse width written, -1 before the first write: the PWM stays
+ * disabled and the servo where it was until then
+ */
+static int i32_pulse_us = -1;
+static DEFINE_MUTEX(pwm_lock);
+
+/*===============================================================================================*/
+/*
+ * set the pulse width, clamped to what the servo accepts, the first
+ * write enables the PWM
+ */
+int rpiservo_write_us(int i32_value) {
+  int i32_ret = 0;
+
+  i32_value = clamp_t(int, i32_value, MIN_PULSE_WIDTH_US, MAX_PULSE_WIDTH_US);
+
+  mutex_lock(&pwm_lock);
+  i32_ret = pwm_config(gpst_pwm, i32_value * 1000, SERVO_PERIOD_US * 1000);
+  if(i32_ret == 0 && i32_pulse_us < 0) {
+    i32_ret = pwm_enable(gpst_pwm);
+  }
+  if(i32_ret == 0) {
+    i32_pulse_us = i32_value;
+  }
+  mutex_unlock(&pwm_lock);
+  return i32_ret;
+}
+
+/*===============================================================================================*/
+/*
+ * temperature in degrees Celsius over the whole servo range
+ */
+int rpiservo_write_temp(int i32_value) {
+  i32_value = clamp_t(int, i32_value, MIN_TEMP, MAX_TEMP);
+  return rpiservo_write_us(MIN_PULSE_WIDTH_US +
+                           i32_value * (MAX_PULSE_WIDTH_US - MIN_PULSE_WIDTH_US) / MAX_TEMP);
+}
+
+/*===============================================================================================*/
+/*
+ * angle in degrees, 0..180
+ */
+int rpiservo_write_angle(int i32_value) {
+  i32_value = clamp_t(int, i32_value, 0, 180);
+  return rpiservo_write_us(MIN_PULSE_WIDTH_US +
+                           i32_value * (MAX_PULSE_WIDTH_US - MIN_PULSE_WIDTH_US) / 180);
+}
+
+/*===============================================================================================*/
+/*
+ * sysfs attributes: pulse_us, temp and angle. Reading any of them gives
+ * the current position in its unit.
+ */
+static ssize_t rpiservo_store(const char *buf, size_t count, int (*write)(int)) {
+  int i32_value = 0;
+  int i32_ret = kstrtoint(buf, 10, &i32_value);
+  if(i32_ret != 0) {
+    return i32_ret;
+  }
+  i32_ret = write(i32_value);
+  if(i32_ret != 0) {
+    return i32_ret;
+  }
+  return count;
+}
+
+static ssize_t pulse_us_show(struct device *dev, struct device_attribute *attr, char *buf) {
+  return sprintf(buf, "%d\n", i32_pulse_us);
+}
+
+static ssize_t pulse_us_store(struct device *dev, struct device_attribute *attr,
+                              const char *buf, size_t count) {
+  return rpiservo_store(buf, count, rpiservo_write_us);
+}
+
+static ssize_t temp_show(struct device *dev, struct device_attribute *attr, char *buf) {
+  if(i32_pulse_us < 0) {
+    return sprintf(buf, "-1\n");
+  }
+  return sprintf(buf, "%d\n", (i32_pulse_us - MIN_PULSE_WIDTH_US) * MAX_TEMP /
+                             (MAX_PULSE_WIDTH_US - MIN_PULSE_WIDTH_US));
+}
+
+static ssize_t temp_store(struct device *dev, struct device_attribute *attr,
+                          const char *buf, size_t count) {
+  return rpiservo_store(buf, count, rpiservo_write_temp);
+}
+
+static ssize_t angle_show(struct device *dev, struct device_attribute *attr, char *buf) {
+  if(i32_pulse_us < 0) {
+    return sprintf(buf, "-1\n");
+  }
+  return sprintf(buf, "%d\n", (i32_pulse_us - MIN_PULSE_WIDTH_US) * 180 /
+                             (MAX_PULSE_WIDTH_US - MIN_PULSE_WIDTH_US));
+}
+
+static ssize_t angle_store(struct device *dev, struct device_attribute *attr,
+                           const char *buf, size_t count) {
+  return rpiservo_store(buf, count, rpiservo_write_angle);
+}
+
+static DEVICE_ATTR_RW(pulse_us);
+static DEVICE_ATTR_RW(temp);
+static DEVICE_ATTR_RW(angle);
+
+static struct attribute *rpiservo_attrs[] = {
+  &dev_attr_pulse_us.attr,
+  &dev_attr_temp.attr,
+  &dev_attr_angle.attr,
+  NULL,
+};
+ATTRIBUTE_GROUPS(rpiservo);
+
+/*===============================================================================================*/
+/*
+ * Initialize the driver.
+ */
+int __init rpiservo_register_device(void) {
+  printk(KERN_NOTICE "[RPISERVO] init_rpiservo is called." );
+
+  gpst_pwm = pwm_request(pwm, DEVICE_NAME);
+  if(IS_ERR(gpst_pwm)) {
+    printk(KERN_ALERT "[RPISERVO] Error request pwm %d\n", pwm);
+    return PTR_ERR(gpst_pwm);
+  }
+
+  if ((gpst_rpiservo_class = class_create(THIS_MODULE, CLASS_NAME) ) == NULL) {
+    printk(KERN_ALERT "[RPISERVO] class creation failed\n" );
+    pwm_free(gpst_pwm);
+    return -1;
+  }
+
+  gpst_rpiservo_device = device_create_with_groups(gpst_rpiservo_class, NULL, MKDEV(0, 0), NULL,
+                                                   rpiservo_groups, DEVICE_NAME);
+  if (IS_ERR_OR_NULL(gpst_rpiservo_device)) {
+    printk(KERN_ALERT "[RPISERVO] device creation failed\n" );
+    class_destroy(gpst_rpiservo_class);
+    pwm_free(gpst_pwm);
+    return -1;
+  }
+
+  printk(KERN_ALERT "[RPISERVO] LOADED\n");
+
+  return 0;
+}
+
+/*===============================================================================================*/
+/*
+ * Cleanup and unregister the driver.
+ */
+void __exit rpiservo_unregister_device(void) {
+    device_unregister(gpst_rpiservo_device);
+    if(i32_pulse_us >= 0) {
+      pwm_disable(gpst_pwm);
+    }
+    class_destroy(gpst_rpiservo_class);
+    pwm_free(gpst_pwm);
+}
@@ -0,0 +1,9 @@
+#ifndef DEVICE_FILE_H_
+#define DEVICE_FILE_H_
+#include <linux/compiler.h> /* __must_check */
+
+__must_check int rpiservo_register_device(void); /* 0 if Ok*/
+
+void rpiservo_unregister_device(void);
+
+#endif //DEVICE_FILE_H_
@@ -0,0 +1,25 @@
+#include "device_file.h"
+#include <linux/init.h>       /* module_init, module_exit */
+#include <linux/module.h> /* version info, MODULE_LICENSE, MODULE_AUTHOR, printk() */
+
+/*===============================================================================================*/
+static int rpiservo_driver_init(void) {
+  int result = 0;
+  printk(KERN_NOTICE "[RPISERVO]: Initialization started");
+
+  result = rpiservo_register_device();
+  return result;
+}
+
+static void rpiservo_driver_exit(void) {
+  printk(KERN_NOTICE "[RPISERVO]: Exiting");
+  rpiservo_unregister_device();
+}
+
+/*===============================================================================================*/
+module_init(rpiservo_driver_init);
+module_exit(rpiservo_driver_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Maciej Zakrzewski");
+MODULE_DESCRIPTION("SG90 servo driver (kernel PWM) for raspberry PI");